@@ -5,109 +5,195 @@
  * Press Esc to quit program
  * Press 'Z' to toggle Linear Interpolation
  * Press 'X' to toggle Plain circle
+ * Press 'A' to toggle Adaptive (quadtree) marching squares
+ * Press 'C' to toggle the cell cache (only re-emit and upload cells that changed)
+ * Press 'O' to toggle contour outlines (full grid mode only)
+ * Press 'S' to toggle Douglas-Peucker simplified outlines
+ * Press '3' to toggle 3D metaballs (marching cubes)
+ * Press 'B' to toggle iso-bands (halo, body and core levels in one pass)
+ * Press 'N' to toggle narrow-band field evaluation (only near last frame's contour)
+ * Press 'F' to toggle the frame rate cap
  * 
+ * Command line:
+ * -w WxH     window size, default 800x600
+ * -g CXxCY   marching squares cells, default 40x30. Resizing the window keeps the cell size
+ * -v N       marching cubes along the longest side in 3D mode, default 64
+ * -r N       simulation steps per second, default 60. Balls move the same whatever the frame rate
+ * -f N       frame rate cap, default 60. 0 draws as fast as possible
+ * -s N       random seed of the bounces, default 1. Same seed, same run
 */
 
 //=======Include=======//
 #include <math.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cstdio>
+#include <vector>
+#include <chrono>
 #ifdef __APPLE__
   #include <OpenGL/gl.h>
   #include <OpenGL/glu.h>
   #include <GLUT/glut.h>
 #elif __linux__
+  #define GL_GLEXT_PROTOTYPES
   #include <GL/gl.h>
   #include <GL/glut.h> 
 #endif
+
+#include "metaball/ball.h"
+#include "metaball/field.h"
+#include "metaball/march.h"
+#include "metaball/quadtree.h"
+#include "metaball/march_cache.h"
+#include "metaball/contour.h"
+#include "metaball/march3d.h"
+#include "metaball/narrow_band.h"
+#include "metaball/classify.h"
 //=======Constant=======//
+//default window size
 #define X_RESOLUTION 800 
 #define Y_RESOLUTION 600 
-#define UNDEFINED -1
-#define NORTH 0
-#define NORTHEAST 1
-#define EAST 2
-#define SOUTHEAST 3
-#define SOUTH 4
-#define SOUTHWEST 5
-#define WEST 6
-#define NORTHWEST 7
-#define TRUE 1
-#define FALSE 0
 
+//default marching squares cells
 #define CELL_X 40
 #define CELL_Y 30
-//=======Struct=======//
-/**int r,g,b
-*/
-typedef struct ball_color
-{
-  int r;
-  int g;
-  int b;
-} ball_color;
-
-/**int x,y,z; direction, see #define
-*/
-typedef struct vec3
-{
-  int x;
-  int y;
-  int z;
-  int direction;
-} vec3;
-
-/**vec3 position, int radius, ball_color color
-*/
-typedef struct ball_type
-{
-  vec3 position;
-  int radius;
-  ball_color color;
-} ball_type;
+#define ISO_THRESHOLD 1.0f
+//how far (pixel) an edge crossing may drift before the cell cache re-emits it
+#define CACHE_TOLERANCE 0.25f
+//largest distance (pixel) simplified outlines may stray from the contour
+#define SIMPLIFY_EPSILON 0.5f
+//default marching cubes along the longest side
+#define VOLUME_CELLS 64
+//iso-band levels, ascending: halo, body, core
+#define BAND_COUNT 3
+const float band_levels[BAND_COUNT] = {0.5f, ISO_THRESHOLD, 2.0f};
+const unsigned char band_colors[BAND_COUNT][3] = {{0, 0x50, 0}, {0, 0xff, 0}, {0xa0, 0xff, 0xa0}};
+#define BALL_COUNT 8
+#define BALL_RADIUS 50
+//vertices of a plain circle outline
+#define CIRCLE_SEGMENTS 24
+//default simulation steps and drawn frames per second
+#define SIM_RATE 60
+#define FRAME_CAP 60
+//fixed default seed so runs repeat
+#define SEED 1
+//steps one frame may catch up before the backlog is dropped, so a stall does not snowball
+#define MAX_SIM_STEPS 8
 //=======Global Var=======//
-ball_type ball1;
-ball_type ball2;
-ball_type ball3;
-ball_type ball4;
-ball_type ball5;
-ball_type ball6;
-ball_type ball7;
-ball_type ball8;
+ball_set balls;
+//ball centers before the last simulation step, drawing blends from them to the current ones
+int prev_x[BALL_COUNT], prev_y[BALL_COUNT];
+//unit circle, x,y pairs, and every ball outline expanded from it for one draw call
+float unit_circle[CIRCLE_SEGMENTS * 2];
+std::vector<float> circle_verts;
+std::vector<GLint> circle_first;
+std::vector<GLsizei> circle_count;
+//fixed timestep: steps per second, time not simulated yet (second), monotonic time of the last tick
+int sim_rate;
+double sim_accum;
+std::chrono::steady_clock::time_point sim_clock;
+//frame rate cap (0 for none), and the current frame timer so a toggled-off one stops rescheduling
+int frame_cap;
+bool capped;
+int frame_timer_id;
+//seed of the ball bounces
+unsigned int seed;
 
-//data matrix for marching square corners. Float value is for Linear Interpolation
-float dat_mat [CELL_X+1][CELL_Y+1]; 
-//global control for Linear Interpolation, Plain Circle 
-bool linear_interp, plain_circle;
+//world size, follows the window
+int world_w, world_h;
+//marching square corners. Float value is for Linear Interpolation. Only allocated while a mode reads it
+field_grid grid;
+//cells of the grid for the current window, kept while the grid is not allocated
+int grid_cells_x, grid_cells_y;
+//world units per cell, kept when the window is resized
+float cell_size_x, cell_size_y;
+//metaball triangles, rebuilt every frame
+std::vector<float> meta_tris;
+//ball centers and radius squared as the field sees them
+float ball_x[BALL_COUNT], ball_y[BALL_COUNT], ball_r2[BALL_COUNT];
+//quadtree state for adaptive marching squares
+quad_march adaptive_march;
+//cell cache, and the vertex buffer holding one slot per cache block
+march_cache meta_cache;
+GLuint meta_vbo;
+std::vector<GLint> slot_first;
+std::vector<GLsizei> slot_count, slot_cap;
+//stitched outlines, and their simplified version
+contour_set outline, outline_simple;
+//3D metaballs: cubes along the longest side, and the polygonized surface
+int volume_cells;
+mesh3d meta_mesh;
+//narrow-band state: which corners are evaluated this frame
+narrow_band meta_band;
+//fused field and classification: crossed cells and inside runs, the full field is never stored
+cell_list meta_cells;
+//fill triangles and contour segments of every iso-band level
+std::vector<float> band_fill[BAND_COUNT], band_lines[BAND_COUNT];
+//global control for Linear Interpolation, Plain Circle, Adaptive marching squares, Cell cache, Outlines, 3D, Iso-bands, Narrow band
+bool linear_interp, plain_circle, adaptive, cached, outlines, simplify, view3d, bands, narrow;
 //=======Func Proto=======//
-/**Determine whether the ball hit the wall
- * @param ball_type The ball to be checked
- * @return TRUE if hit; FALSE if not hit. NOTE: TRUE, FALSE defined as 1 and 0
-*/
-int ball_hit_wall (ball_type);
-/**Generate a new direction with a given ball
- * @param ball_type ball to be analyzed
- * @return direction
-*/
-int select_ball_direction (ball_type);
-/**Move the ball position by 1 on X axis or Y axis or both, depending on the ball direction
- * @param ball_type ball to be moved
- * @return new ball data.
+/**Fill unit_circle, once
 */
-ball_type move_ball (ball_type);
-/**The draw function for balls
- * @param ball_type ball to be drawn
+void init_circle ();
+/**The draw function for balls: every outline is the unit circle scaled and moved
+ * into circle_verts, then all of them go out in one draw call
 */
-void draw_ball (ball_type ball);
-/**The draw function for metaballs. Using global variables of balls
+void draw_balls ();
+/**The draw function for metaballs. Using global variables of grid, or the quadtree in adaptive mode
  * 
 */
 void draw_meta ();
-/**Calculate Marching squares corners value. Using global variables of dat_mat
- * 
+/**Upload the cache blocks re-emitted this frame into their slot of meta_vbo.
+ * Slots are laid out again (full upload) only when a block outgrows its slot
+*/
+void upload_meta_cache ();
+/**Stitch the contour of the grid into polylines and draw them as indexed line strips
+*/
+void draw_outline ();
+/**The draw function for iso-bands: every level from one pass over the grid, painted
+ * from the lowest up, with the level contours on top when outlines are on
+*/
+void draw_bands ();
+/**The draw function for 3D metaballs. Same balls, spread in depth, polygonized with marching cubes
+*/
+void draw_meta3d ();
+/**Calculate Marching squares corners value. Using global variables of grid.
+ * Balls are blended between the last two simulation steps by how far the clock is into the next one.
+ * Adaptive mode only gathers the balls, the quadtree evaluates the corners it needs.
+ * Narrow-band mode evaluates only around the contour (not with iso-bands, their other levels need every corner)
+ * The plain full grid path evaluates and classifies in one pass, see fused_meta
 */
 void calc_dat_mat();
+/**The plain full grid path (no cell cache, quadtree, narrow band, iso-bands, 3D or outlines)
+ * only needs the cell classes, so it uses the fused pass instead of the field grid
+*/
+bool fused_meta ();
+/**Allocate the field grid for the current window when a mode that reads it is on (cell cache,
+ * quadtree, narrow band, iso-bands, outlines), free it otherwise: the fused pass and 3D never do
+*/
+void fit_grid ();
+/**Keep the ball inside the world after the window shrinks
+ * @param b index of the ball to be clamped
+*/
+void clamp_ball (int b);
+/**Run the simulation steps the monotonic clock is due, at most MAX_SIM_STEPS
+*/
+void advance_sim ();
+/**Uncapped: redraw whenever GLUT is idle
+*/
+void idle ();
+/**Capped: redraw every 1/frame_cap second, the process sleeps in between
+ * @param id frame timer the call belongs to, stale timers stop
+*/
+void frame_timer (int id);
+/**Switch between the capped timer and the uncapped idle loop
+*/
+void start_frames ();
+/**Parse command line options, see key mapping
+ * @return false on bad option
+*/
+bool parse_options (int argc, char *argv[]);
 
 void display (void);
 void reshape (int, int);
@@ -115,882 +201,393 @@ void reshape (int, int);
  * Press Esc to quit program
  * Press 'Z' to toggle Linear Interpolation
  * Press 'X' to toggle Plain circle 
+ * Press 'A' to toggle Adaptive (quadtree) marching squares
+ * Press 'C' to toggle the cell cache
+ * Press 'O' to toggle contour outlines
+ * Press 'S' to toggle simplified outlines
+ * Press '3' to toggle 3D metaballs
+ * Press 'B' to toggle iso-bands
+ * Press 'N' to toggle narrow-band field evaluation
+ * Press 'F' to toggle the frame rate cap
 */
 void keyboard (unsigned char, int, int);
 
 //=======Func Implementations=======//
-int ball_hit_wall (ball_type ball)
+void init_circle ()
+{
+  for (int k=0; k<CIRCLE_SEGMENTS; k++)
+  {
+    double theta = 2.0 * M_PI * k / CIRCLE_SEGMENTS;
+    unit_circle[k*2+0] = (float)cos (theta);
+    unit_circle[k*2+1] = (float)sin (theta);
+  }
+}
+void draw_balls ()
 {
-  int ball_hit_wall;
+  int n = balls.count;
 
-  ball_hit_wall = FALSE; //default false
-  switch (ball.position.direction) //Direction determine which side potentially collide
+  if (n == 0)
+    return;
+  if ((int)circle_first.size() != n)
   {
-    case NORTH:
-      if ((ball.position.y - ball.radius) <= 0)
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case NORTHEAST:
-      if (((ball.position.y - ball.radius) <= 0) || ((ball.position.x + ball.radius) >= X_RESOLUTION))
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case EAST:
-      if ((ball.position.x + ball.radius) >= X_RESOLUTION)
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case SOUTHEAST:
-      if (((ball.position.y + ball.radius) >= Y_RESOLUTION) || ((ball.position.x + ball.radius) >= X_RESOLUTION))
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case SOUTH:
-      if ((ball.position.y + ball.radius) >= Y_RESOLUTION)
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case SOUTHWEST:
-      if (((ball.position.y + ball.radius) >= Y_RESOLUTION) || ((ball.position.x - ball.radius) <= 0))
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case WEST:
-      if ((ball.position.x - ball.radius) <= 0)
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    case NORTHWEST:
-      if (((ball.position.y - ball.radius) <= 0) || ((ball.position.x - ball.radius) <= 0))
-      {
-        ball_hit_wall = TRUE;
-      }
-    break;
-    default:
-    break;
+    circle_first.resize (n);
+    circle_count.assign (n, CIRCLE_SEGMENTS);
+    for (int b=0; b<n; b++)
+      circle_first[b] = b * CIRCLE_SEGMENTS;
+  }
+  circle_verts.resize ((size_t)n * CIRCLE_SEGMENTS * 2);
+  for (int b=0; b<n; b++)
+  {
+    float* out = &circle_verts[(size_t)b * CIRCLE_SEGMENTS * 2];
+    float x = ball_x[b], y = ball_y[b], radius = (float)balls.radius[b];
+    for (int k=0; k<CIRCLE_SEGMENTS; k++)
+    {
+      out[k*2+0] = x + unit_circle[k*2+0] * radius;
+      out[k*2+1] = y + unit_circle[k*2+1] * radius;
+    }
   }
-  return ball_hit_wall;
+
+  glColor3ub (255, 255, 0);
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glVertexPointer (2, GL_FLOAT, 0, &circle_verts[0]);
+  glMultiDrawArrays (GL_LINE_LOOP, &circle_first[0], &circle_count[0], n);
+  glDisableClientState (GL_VERTEX_ARRAY);
 }
-int select_ball_direction (ball_type ball)
+void upload_meta_cache ()
 {
-  int new_ball_direction, random_direction;
-  float new_move_north, new_move_northeast, new_move_east, new_move_southeast, new_move_south, new_move_southwest, new_move_west, new_move_northwest;
-  float random_number, lower_bound, upper_bound;
+  size_t tiles = (size_t)meta_cache.tiles_x * meta_cache.tiles_y;
+  bool relayout = meta_cache.rebuilt || slot_cap.size() != tiles;
+
+  for (size_t t=0; t<tiles && !relayout; t++)
+    if (meta_cache.dirty[t] && (GLsizei)(meta_cache.tile_tris[t].size() / 2) > slot_cap[t])
+      relayout = true;
 
-  switch (ball.position.direction)
+  if (meta_vbo == 0)
+    glGenBuffers (1, &meta_vbo);
+  glBindBuffer (GL_ARRAY_BUFFER, meta_vbo);
+  if (relayout)
   {
-    case NORTH:
-      if (((ball.position.x - ball.radius) <= 0) && ((ball.position.y - ball.radius) <= 0)) //collide left && collide top
-      {
-        new_ball_direction = SOUTHEAST;
-      }
-      else
-      {
-        if (((ball.position.x + ball.radius) >= X_RESOLUTION) && ((ball.position.y - ball.radius) <= 0)) //collide right && collide top
-        {
-          new_ball_direction = SOUTHWEST;
-        }
-        else //RNG to determine SW or SE
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = SOUTHEAST;
-            break;
-            case 1:
-              new_ball_direction = SOUTHWEST;
-            break;
-            default:
-              new_ball_direction = SOUTHEAST;
-            break;
-          }
-        }
-      }     
-    break;
-    case NORTHEAST:
-      if ((ball.position.x + ball.radius) >= X_RESOLUTION) //collide right
-      {
-        if ((ball.position.y - ball.radius) <= 0) //collide top
-        {
-          new_ball_direction = SOUTHWEST; //top right collision
-        }
-        else
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = NORTHWEST;
-            break;
-            case 1:
-              new_ball_direction = WEST;
-            break;
-            default:
-              new_ball_direction = NORTHWEST;
-            break;
-          }
-        }
-      }
-      else
-      {
-        random_number = (float) random() / (float) RAND_MAX * 2.0f;
-        random_direction = (int) random_number;
-        switch (random_direction)
-        {
-          case 0:
-            new_ball_direction = SOUTHEAST;
-          break;
-          case 1:
-            new_ball_direction = EAST;
-          break;
-          default:
-            new_ball_direction = SOUTHEAST;
-          break;
-        }
-      }
-    break;
-    case EAST:
-      if ((ball.position.y - ball.radius) <= 0)
-      {
-        new_ball_direction = SOUTHWEST;
-      }
-      else
-      {
-        if ((ball.position.y + ball.radius) >= Y_RESOLUTION)
-        {
-          new_ball_direction = NORTHWEST; 
-        }
-        else
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = NORTHWEST; 
-            break;
-            case 1:
-              new_ball_direction = SOUTHWEST;
-            break;
-            default:
-              new_ball_direction = NORTHWEST;
-            break;
-          }
-        }
-      }
-    break;
-    case SOUTHEAST:
-      if ((ball.position.y + ball.radius) >= Y_RESOLUTION)
-      {
-        if ((ball.position.x + ball.radius) >= X_RESOLUTION)
-        {
-          new_ball_direction = NORTHWEST;
-        }
-        else
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = NORTH;
-            break;
-            case 1:
-              new_ball_direction = NORTHEAST;
-            break;
-            case 2:
-              new_ball_direction = EAST;
-            break;
-            default:
-              new_ball_direction = NORTH;
-            break;
-          }
-        }
-      }
-      else
-      {
-        random_number = (float) random() / (float) RAND_MAX * 2.0f;
-        random_direction = (int) random_number;
-        switch (random_direction)
-        {
-          case 0:
-            new_ball_direction = SOUTH;
-          break;
-          case 1:
-            new_ball_direction = SOUTHWEST;
-          break;
-          case 2:
-            new_ball_direction = WEST;
-          break;
-          default:
-            new_ball_direction = SOUTH;
-          break;
-        }
-      }
-    break;
-    case SOUTH:
-      if ((ball.position.x + ball.radius) >= X_RESOLUTION)
-      {
-        new_ball_direction = NORTHWEST;
-      }
-      else
-      {
-        new_ball_direction = NORTHEAST;
-      }
-    break;
-    case SOUTHWEST:
-      if ((ball.position.x - ball.radius) <= 0)
-      { 
-        if ((ball.position.y + ball.radius) >= Y_RESOLUTION)
-        {
-          new_ball_direction = NORTHEAST;
-        }
-        else
-        {
-          new_ball_direction = SOUTHEAST;
-        }
-      }
-      else
-      {
-        random_number = (float) random() / (float) RAND_MAX * 2.0f;
-        random_direction = (int) random_number;
-        switch (random_direction)
-        {
-          case 0:
-            new_ball_direction = NORTH;
-          break;
-          case 1:
-            new_ball_direction = NORTHWEST;
-          break;
-          case 2:
-            new_ball_direction = WEST;
-          break;
-          default:
-            new_ball_direction = NORTH;
-          break;
-        }
-      }
-    break;
-    case WEST:
-      if ((ball.position.y - ball.radius) <= 0)
-      {
-        new_ball_direction = SOUTHEAST;
-      }
-      else
-      {
-        if ((ball.position.y + ball.radius) >= Y_RESOLUTION)
-        {
-          new_ball_direction = NORTHEAST;
-        }
-        else
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = NORTHEAST;
-            break;
-            case 1:
-              new_ball_direction = SOUTHEAST;
-            break;
-            default:
-              new_ball_direction = NORTHEAST;
-            break;
-          }
-        }
-      }
-    break;
-    case NORTHWEST:
-      if ((ball.position.x - ball.radius) <= 0)
-      { 
-        if ((ball.position.y - ball.radius) <= 0)
-        {
-          new_ball_direction = SOUTHEAST;
-        }
-        else
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = NORTHEAST;
-            break;
-            case 1:
-              new_ball_direction = EAST;
-            break;
-            default:
-              new_ball_direction = NORTHEAST;
-            break;
-          }
-        }
-      }
-      else
-      {
-        if ((ball.position.y - ball.radius) <= 0)
-        {
-          random_number = (float) random() / (float) RAND_MAX * 2.0f;
-          random_direction = (int) random_number;
-          switch (random_direction)
-          {
-            case 0:
-              new_ball_direction = SOUTHWEST;
-            break;
-            case 1:
-              new_ball_direction = SOUTH;
-            break;
-            case 2:
-              new_ball_direction = WEST;
-            break;
-            default:
-              new_ball_direction = SOUTHWEST;
-            break;
-          }
-        }
-      }
-    break;
-    default:
-    break;
+    // room to grow by half before the next full upload
+    GLint total = 0;
+    slot_first.resize (tiles);
+    slot_count.resize (tiles);
+    slot_cap.resize (tiles);
+    for (size_t t=0; t<tiles; t++)
+    {
+      slot_count[t] = (GLsizei)(meta_cache.tile_tris[t].size() / 2);
+      slot_cap[t] = slot_count[t] + slot_count[t] / 2 + 24;
+      slot_first[t] = total;
+      total += slot_cap[t];
+    }
+    glBufferData (GL_ARRAY_BUFFER, (GLsizeiptr)total * 2 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
   }
-  ball.position.direction = new_ball_direction;
-  return ball.position.direction;
+  for (size_t t=0; t<tiles; t++)
+  {
+    if (!relayout && !meta_cache.dirty[t])
+      continue;
+    slot_count[t] = (GLsizei)(meta_cache.tile_tris[t].size() / 2);
+    if (slot_count[t] > 0)
+      glBufferSubData (GL_ARRAY_BUFFER, (GLintptr)slot_first[t] * 2 * sizeof(float),
+                       (GLsizeiptr)slot_count[t] * 2 * sizeof(float), &meta_cache.tile_tris[t][0]);
+  }
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
 }
-ball_type move_ball (ball_type ball)
+void draw_outline ()
 {
-  ball_type new_ball;
+  contour_set* lines = &outline;
+  std::vector<GLsizei> counts;
+  std::vector<const GLvoid*> starts;
 
-  new_ball = ball;
-  switch (ball.position.direction)
+  contour_extract (&grid, ISO_THRESHOLD, linear_interp, &outline);
+  if (simplify)
   {
-    case NORTH:
-      new_ball.position.y--;
-    break;
-    case NORTHEAST:
-      new_ball.position.x++;
-      new_ball.position.y--;
-    break;
-    case EAST:
-      new_ball.position.x++;
-    break;
-    case SOUTHEAST:
-      new_ball.position.x++;
-      new_ball.position.y++;
-    break;
-    case SOUTH:
-      new_ball.position.y++;
-    break;
-    case SOUTHWEST:
-      new_ball.position.x--;
-      new_ball.position.y++;
-    break;
-    case WEST:
-      new_ball.position.x--;
-    break;
-    case NORTHWEST:
-      new_ball.position.x--;
-      new_ball.position.y--;
-    break;
-    default:
-    break;
+    contour_simplify (&outline, SIMPLIFY_EPSILON, &outline_simple);
+    lines = &outline_simple;
+  }
+  if (contour_lines (lines) == 0)
+    return;
+  for (int l=0; l<contour_lines (lines); l++)
+  {
+    counts.push_back ((GLsizei)(lines->line_start[l+1] - lines->line_start[l]));
+    starts.push_back (&lines->index[lines->line_start[l]]);
   }
-  return new_ball;
+  glColor3ub (0xff, 0xff, 0xff);
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glVertexPointer (2, GL_FLOAT, 0, &lines->verts[0]);
+  glMultiDrawElements (GL_LINE_STRIP, &counts[0], GL_UNSIGNED_INT, &starts[0], (GLsizei)counts.size());
+  glDisableClientState (GL_VERTEX_ARRAY);
 }
-void draw_ball (ball_type ball)
+void draw_meta3d ()
 {
-  float theta, circle_iterations = 12.0;
+  // cubes stay cubes: the longest side gets volume_cells of them
+  float depth = (float)(world_w < world_h ? world_w : world_h) / 2.0f;
+  float cube = (float)(world_w > world_h ? world_w : world_h) / (float)volume_cells;
+  volume_grid vol;
+  vol.width = (float)world_w;
+  vol.height = (float)world_h;
+  vol.depth = depth;
+  vol.cell_x = (int)ceilf (vol.width / cube);
+  vol.cell_y = (int)ceilf (vol.height / cube);
+  vol.cell_z = (int)ceilf (vol.depth / cube);
+  float ball_z[BALL_COUNT];
+  for (int b=0; b<BALL_COUNT; b++)
+    ball_z[b] = depth * (float)(b + 1) / (float)(BALL_COUNT + 1);
+  march3d_volume (&vol, ball_x, ball_y, ball_z, ball_r2, BALL_COUNT, ISO_THRESHOLD, 0, &meta_mesh);
+  if (meta_mesh.index.empty())
+    return;
 
-  glColor3ub (ball.color.r, ball.color.g, ball.color.b);
-  glPolygonMode (GL_FRONT_AND_BACK, GL_LINE);
-  glBegin (GL_POLYGON);
-  glVertex3f (ball.position.x + ball.radius, ball.position.y, 0.0f);
-  for (theta = 0; theta < 2 * M_PI; theta += M_PI / circle_iterations)
+  GLfloat light_pos[4] = {0.3f, -0.3f, 1.0f, 0.0f};
+  glMatrixMode (GL_PROJECTION);
+  glPushMatrix ();
+  glLoadIdentity ();
+  glOrtho (0.0, world_w, world_h, 0, -2.0 * depth, 2.0 * depth);
+  glMatrixMode (GL_MODELVIEW);
+  glClear (GL_DEPTH_BUFFER_BIT);
+  glEnable (GL_DEPTH_TEST);
+  glEnable (GL_LIGHTING);
+  glEnable (GL_LIGHT0);
+  glLightfv (GL_LIGHT0, GL_POSITION, light_pos);
+  glLightModelf (GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+  glEnable (GL_COLOR_MATERIAL);
+  glColor3ub (0, 0xff, 0);
+  glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_NORMAL_ARRAY);
+  glVertexPointer (3, GL_FLOAT, 0, &meta_mesh.verts[0]);
+  glNormalPointer (GL_FLOAT, 0, &meta_mesh.normals[0]);
+  glDrawElements (GL_TRIANGLES, (GLsizei)meta_mesh.index.size(), GL_UNSIGNED_INT, &meta_mesh.index[0]);
+  glDisableClientState (GL_NORMAL_ARRAY);
+  glDisableClientState (GL_VERTEX_ARRAY);
+  glDisable (GL_COLOR_MATERIAL);
+  glDisable (GL_LIGHTING);
+  glDisable (GL_DEPTH_TEST);
+  glMatrixMode (GL_PROJECTION);
+  glPopMatrix ();
+  glMatrixMode (GL_MODELVIEW);
+}
+void draw_bands ()
+{
+  march_bands (&grid, band_levels, BAND_COUNT, linear_interp, band_fill, outlines ? band_lines : NULL);
+  glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
+  glEnableClientState (GL_VERTEX_ARRAY);
+  for (int l=0; l<BAND_COUNT; l++)
   {
-    glVertex3f (ball.position.x + cos(theta) * ball.radius, ball.position.y + sin(theta) * ball.radius, 0.0f);
+    if (band_fill[l].empty())
+      continue;
+    glColor3ub (band_colors[l][0], band_colors[l][1], band_colors[l][2]);
+    glVertexPointer (2, GL_FLOAT, 0, &band_fill[l][0]);
+    glDrawArrays (GL_TRIANGLES, 0, (GLsizei)(band_fill[l].size() / 2));
   }
-  glEnd();
+  if (outlines)
+  {
+    glColor3ub (0xff, 0xff, 0xff);
+    for (int l=0; l<BAND_COUNT; l++)
+    {
+      if (band_lines[l].empty())
+        continue;
+      glVertexPointer (2, GL_FLOAT, 0, &band_lines[l][0]);
+      glDrawArrays (GL_LINES, 0, (GLsizei)(band_lines[l].size() / 2));
+    }
+  }
+  glDisableClientState (GL_VERTEX_ARRAY);
 }
 void draw_meta ()
 {
   glColor3ub (0, 0xff, 0);
   glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
-  if (linear_interp)
+  if (!adaptive && cached)
   {
-    for (int i=0; i<CELL_X; i++)
-      for (int j=0; j<CELL_Y; j++)
-      {
-        float cw = (float)X_RESOLUTION/(float)CELL_X; //cell width
-        float ch = (float)Y_RESOLUTION/(float)CELL_Y; //cell height
-        float x0   = ((float)i)*cw; //left corners of the cell
-        float y0   = ((float)j)*ch; //top corners of the cell
-        float x1   = ((float)i+1.0f)*cw; //right corners of the cell
-        float y1   = ((float)j+1.0f)*ch; //bottom corners of the cell
-        
-        //temp rename for cell corners values
-        float p00  = dat_mat[i][j];     
-        float p10  = dat_mat[i+1][j];
-        float p01  = dat_mat[i][j+1];
-        float p11  = dat_mat[i+1][j+1];
-
-        // mid value
-        float tMid = cw * (1.0-p00)/(p10-p00) + x0; //top mid
-        float lMid = ch * (1.0-p00)/(p01-p00) + y0; //left mid
-        float bMid = cw * (1.0-p01)/(p11-p01) + x0; //botton mid
-        float rMid = ch * (1.0-p10)/(p11-p10) + y0; //left mid
+    march_cache_update (&meta_cache, &grid, ISO_THRESHOLD, linear_interp, CACHE_TOLERANCE);
+    upload_meta_cache ();
+    if (slot_first.empty())
+      return;
+    glBindBuffer (GL_ARRAY_BUFFER, meta_vbo);
+    glEnableClientState (GL_VERTEX_ARRAY);
+    glVertexPointer (2, GL_FLOAT, 0, (const GLvoid*)0);
+    glMultiDrawArrays (GL_TRIANGLES, &slot_first[0], &slot_count[0], (GLsizei)slot_first.size());
+    glDisableClientState (GL_VERTEX_ARRAY);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    return;
+  }
 
-        unsigned char sqr = 0;
-        //====//
-        //1  2//
-        //4  8//
-        //====//
-        sqr = sqr | (p00>=1.0  ? 1:0);
-        sqr = sqr | (p10>=1.0  ? 2:0);
-        sqr = sqr | (p01>=1.0  ? 4:0);
-        sqr = sqr | (p11>=1.0  ? 8:0);
-        glBegin(GL_POLYGON);
-        /*example
-         o o
-         o x
-         (yMid - y0)    1 - mat(x1,y0)
-         ----------- ~= -------------------------
-         (y1 - y0)      mat(x1,y1) - mat(x1,y0)
-         ============
-         yMid ~= y0 + (y1 - y0)(...)
-        */
-        switch(sqr)
-        {
-          case 0x0:
-            // o o
-            // o o
-            break;
-          case 0x1:
-            // x o
-            // o o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            break;
-          case 0x2:
-            // o x
-            // o o
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            break;
-          case 0x3:
-            // x x
-            // o o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0x4:
-            // o o
-            // x o
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            break;
-          case 0x5:
-            // x o
-            // x o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            break;
-          case 0x6:
-            // o x
-            // x o
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            break;
-          case 0x7:
-            // x x
-            // x o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0x8:
-            // o o
-            // o x
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            break;
-          case 0x9:
-            // x o
-            // o x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            break;
-          case 0xA:
-            // o x
-            // o x
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            break;
-          case 0xB:
-            // x x
-            // o x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(bMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0xC:
-            // o o
-            // x x
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            break;
-          case 0xD:
-            // x o
-            // x x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, rMid, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            break;
-          case 0xE:
-            // o x
-            // x x
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(tMid, y0, 0.0f);
-            glVertex3f(x0, lMid, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            break;
-          case 0xF:
-            // x x
-            // x x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          default:
-            break;
-        }
-        glEnd();
-      }
+  if (adaptive)
+  {
+    quad_march_grid (&adaptive_march, &grid, ball_x, ball_y, ball_r2, BALL_COUNT, ISO_THRESHOLD, linear_interp, &meta_tris);
+  }
+  else if (fused_meta())
+  {
+    classify_triangles (&meta_cells, &meta_tris);
   }
   else
   {
-    for (int i=0; i<CELL_X; i++)
-      for (int j=0; j<CELL_Y; j++)
-      {
-        float cw = (float)X_RESOLUTION/(float)CELL_X; //cell width
-        float ch = (float)Y_RESOLUTION/(float)CELL_Y; //cell height
-        float x0   = ((float)i)*cw; //left corners of the cell
-        float y0   = ((float)j)*ch; //top corners of the cell
-        float x1   = ((float)i+1.0f)*cw; //right corners of the cell
-        float y1   = ((float)j+1.0f)*ch; //bottom corners of the cell
-        float xMid = ((float)i+0.5f)*cw; //X center of the cell
-        float yMid = ((float)j+0.5f)*ch; //Y center of the cell
-        unsigned char sqr = 0;
-        //====//
-        //1  2//
-        //4  8//
-        //====//
-        sqr = sqr | (dat_mat[i][j]>=1.0    ? 1:0);
-        sqr = sqr | (dat_mat[i+1][j]>=1.0  ? 2:0);
-        sqr = sqr | (dat_mat[i][j+1]>=1.0  ? 4:0);
-        sqr = sqr | (dat_mat[i+1][j+1]>=1.0? 8:0);
-        glBegin(GL_POLYGON);
-        switch(sqr)
-        {
-          case 0x0:
-            // o o
-            // o o
-            break;
-          case 0x1:
-            // x o
-            // o o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            break;
-          case 0x2:
-            // o x
-            // o o
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            break;
-          case 0x3:
-            // x x
-            // o o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0x4:
-            // o o
-            // x o
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            break;
-          case 0x5:
-            // x o
-            // x o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            break;
-          case 0x6:
-            // o x
-            // x o
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            break;
-          case 0x7:
-            // x x
-            // x o
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0x8:
-            // o o
-            // o x
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            break;
-          case 0x9:
-            // x o
-            // o x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            break;
-          case 0xA:
-            // o x
-            // o x
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            break;
-          case 0xB:
-            // x x
-            // o x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(xMid, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          case 0xC:
-            // o o
-            // x x
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            break;
-          case 0xD:
-            // x o
-            // x x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, yMid, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            break;
-          case 0xE:
-            // o x
-            // x x
-            glVertex3f(x1, y0, 0.0f);
-            glVertex3f(xMid, y0, 0.0f);
-            glVertex3f(x0, yMid, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            break;
-          case 0xF:
-            // x x
-            // x x
-            glVertex3f(x0, y0, 0.0f);
-            glVertex3f(x0, y1, 0.0f);
-            glVertex3f(x1, y1, 0.0f);
-            glVertex3f(x1, y0, 0.0f);
-            break;
-          default:
-            break;
-        }
-        glEnd();
-      }
+    march_grid (&grid, ISO_THRESHOLD, linear_interp, &meta_tris);
   }
+  if (meta_tris.empty())
+    return;
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glVertexPointer (2, GL_FLOAT, 0, &meta_tris[0]);
+  glDrawArrays (GL_TRIANGLES, 0, (GLsizei)(meta_tris.size() / 2));
+  glDisableClientState (GL_VERTEX_ARRAY);
 }
 void calc_dat_mat()
 {
-  for (int i=0; i<CELL_X+1; i++)
-    for (int j=0; j<CELL_Y+1; j++)
-    {
-      float tempVar = 0.0f; //temp Answer to be stored in matrix
-      float tempX = (float)i*(float)X_RESOLUTION/(float)CELL_X; //X coordinate of the corner to be checked
-      float tempY = (float)j*(float)Y_RESOLUTION/(float)CELL_Y; //X coordinate of the corner to be checked
-      
-      tempVar += (float)(ball1.radius*ball1.radius)/
-                 ((tempX-(float)ball1.position.x)*(tempX-(float)ball1.position.x)+
-                 (tempY-(float)ball1.position.y)*(tempY-(float)ball1.position.y));
-      tempVar += (float)(ball2.radius*ball2.radius)/
-                 ((tempX-(float)ball2.position.x)*(tempX-(float)ball2.position.x)+
-                 (tempY-(float)ball2.position.y)*(tempY-(float)ball2.position.y));
-      tempVar += (float)(ball3.radius*ball3.radius)/
-                 ((tempX-(float)ball3.position.x)*(tempX-(float)ball3.position.x)+
-                 (tempY-(float)ball3.position.y)*(tempY-(float)ball3.position.y));
-      tempVar += (float)(ball4.radius*ball4.radius)/
-                 ((tempX-(float)ball4.position.x)*(tempX-(float)ball4.position.x)+
-                 (tempY-(float)ball4.position.y)*(tempY-(float)ball4.position.y));
-      tempVar += (float)(ball5.radius*ball5.radius)/
-                 ((tempX-(float)ball5.position.x)*(tempX-(float)ball5.position.x)+
-                 (tempY-(float)ball5.position.y)*(tempY-(float)ball5.position.y));
-      tempVar += (float)(ball6.radius*ball6.radius)/
-                 ((tempX-(float)ball6.position.x)*(tempX-(float)ball6.position.x)+
-                 (tempY-(float)ball6.position.y)*(tempY-(float)ball6.position.y));
-      tempVar += (float)(ball7.radius*ball7.radius)/
-                 ((tempX-(float)ball7.position.x)*(tempX-(float)ball7.position.x)+
-                 (tempY-(float)ball7.position.y)*(tempY-(float)ball7.position.y));
-      tempVar += (float)(ball8.radius*ball8.radius)/
-                 ((tempX-(float)ball8.position.x)*(tempX-(float)ball8.position.x)+
-                 (tempY-(float)ball8.position.y)*(tempY-(float)ball8.position.y));
-      
-      dat_mat[i][j]=tempVar;
-    }
-  //printf("%f\n",dat_mat[CELL_X/2][CELL_Y/2]);
-}
-void display(void)
-{
-  // * Ball 1 *
-  if (ball_hit_wall(ball1))
-  {
-    ball1.position.direction = select_ball_direction(ball1);
-  }
-  ball1 = move_ball(ball1);
-  // * Ball 2 *
-  if (ball_hit_wall(ball2))
+  float alpha = (float)(sim_accum * sim_rate);
+
+  fit_grid();
+  for (int b=0; b<BALL_COUNT; b++)
   {
-    ball2.position.direction = select_ball_direction(ball2);
+    ball_x[b] = (float)prev_x[b] + (float)(balls.x[b] - prev_x[b]) * alpha;
+    ball_y[b] = (float)prev_y[b] + (float)(balls.y[b] - prev_y[b]) * alpha;
+    ball_r2[b] = (float)(balls.radius[b] * balls.radius[b]);
   }
-  ball2 = move_ball(ball2);
-  // * Ball 3 *
-  if (ball_hit_wall(ball3))
+  if (narrow && !bands && !adaptive && !view3d)
   {
-    ball3.position.direction = select_ball_direction(ball3);
+    narrow_band_update (&meta_band, &grid, ball_x, ball_y, ball_r2, BALL_COUNT, ISO_THRESHOLD);
+    return;
   }
-  ball3 = move_ball(ball3);
-  // * Ball 4 *
-  if (ball_hit_wall(ball4))
+  // the band goes stale while another mode draws
+  narrow_band_reset (&meta_band);
+  if (fused_meta())
+    classify_field (&meta_cells, grid_cells_x, grid_cells_y, (float)world_w, (float)world_h,
+                    ball_x, ball_y, ball_r2, BALL_COUNT, ISO_THRESHOLD, linear_interp);
+  else if (!view3d && (!adaptive || bands))
+    field_grid_eval (&grid, ball_x, ball_y, ball_r2, BALL_COUNT);
+}
+bool fused_meta ()
+{
+  return !cached && !adaptive && !narrow && !bands && !view3d && !outlines;
+}
+void fit_grid ()
+{
+  if (fused_meta() || view3d)
   {
-    ball4.position.direction = select_ball_direction(ball4);
+    field_grid_free (&grid);
+    return;
   }
-  ball4 = move_ball(ball4);
-  // * Ball 5 *
-  if (ball_hit_wall(ball5))
+  if (grid.data != NULL && grid.cell_x == grid_cells_x && grid.cell_y == grid_cells_y &&
+      grid.width == (float)world_w && grid.height == (float)world_h)
+    return;
+  if (!field_grid_resize (&grid, grid_cells_x, grid_cells_y, (float)world_w, (float)world_h))
   {
-    ball5.position.direction = select_ball_direction(ball5);
+    fprintf (stderr, "Cannot allocate %dx%d grid\n", grid_cells_x, grid_cells_y);
+    exit (1);
   }
-  ball5 = move_ball(ball5);
-  // * Ball 6 *
-  if (ball_hit_wall(ball6))
+  // a new grid holds no band yet
+  narrow_band_reset (&meta_band);
+}
+void advance_sim ()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double step = 1.0 / sim_rate;
+  int steps = 0;
+
+  sim_accum += std::chrono::duration<double>(now - sim_clock).count();
+  sim_clock = now;
+  while (sim_accum >= step && steps < MAX_SIM_STEPS)
   {
-    ball6.position.direction = select_ball_direction(ball6);
+    memcpy (prev_x, balls.x, sizeof(prev_x));
+    memcpy (prev_y, balls.y, sizeof(prev_y));
+    // bounce and move every ball
+    ball_set_move (&balls, world_w, world_h);
+    sim_accum -= step;
+    steps++;
   }
-  ball6 = move_ball(ball6);
-  // * Ball 7 *
-  if (ball_hit_wall(ball7))
+  if (sim_accum >= step)
+    sim_accum = 0.0;
+}
+void idle ()
+{
+  advance_sim();
+  glutPostRedisplay();
+}
+void frame_timer (int id)
+{
+  if (id != frame_timer_id)
+    return;
+  advance_sim();
+  glutPostRedisplay();
+  glutTimerFunc (1000 / frame_cap, frame_timer, id);
+}
+void start_frames ()
+{
+  frame_timer_id++;
+  if (capped)
   {
-    ball7.position.direction = select_ball_direction(ball7);
+    glutIdleFunc (NULL);
+    glutTimerFunc (1000 / frame_cap, frame_timer, frame_timer_id);
   }
-  ball7 = move_ball(ball7);
-  // * Ball 8 *
-  if (ball_hit_wall(ball8))
+  else
   {
-    ball8.position.direction = select_ball_direction(ball8);
+    glutIdleFunc (idle);
   }
-  ball8 = move_ball(ball8);
-
+}
+void display(void)
+{
   // clear the screen to black
   glColor3ub(0, 0, 0);
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  glRecti(0, 0, X_RESOLUTION, Y_RESOLUTION);
+  glRecti(0, 0, world_w, world_h);
 
   calc_dat_mat();
-  draw_meta();
+  if (view3d)
+  {
+    draw_meta3d();
+  }
+  else if (bands)
+  {
+    draw_bands();
+  }
+  else
+  {
+    draw_meta();
+    if (outlines && !adaptive)
+      draw_outline();
+  }
 
   if (plain_circle)
   {
-    draw_ball (ball1);
-    draw_ball (ball2);
-    draw_ball (ball3);
-    draw_ball (ball4);
-    draw_ball (ball5);
-    draw_ball (ball6);
-    draw_ball (ball7);
-    draw_ball (ball8);
+    draw_balls();
   }
 
   glutSwapBuffers();
-  glutPostRedisplay();
+}
+void clamp_ball (int b)
+{
+  if (balls.x[b] > world_w - balls.radius[b])
+    balls.x[b] = world_w - balls.radius[b];
+  if (balls.x[b] < balls.radius[b])
+    balls.x[b] = balls.radius[b];
+  if (balls.y[b] > world_h - balls.radius[b])
+    balls.y[b] = world_h - balls.radius[b];
+  if (balls.y[b] < balls.radius[b])
+    balls.y[b] = balls.radius[b];
 }
 void reshape (int w, int h)  
 {
+  if (w == 0)
+    w = 1;
+  if (h == 0)  
+    h = 1;
   glViewport (0, 0, w, h);
   glMatrixMode(GL_PROJECTION); 
   glLoadIdentity();  
-  if (h == 0)  
-  {
-    glOrtho (0.0, X_RESOLUTION, 1, 0, -1.0, 1.0);
-  }
-  else
-  {
-    glOrtho (0.0, X_RESOLUTION, Y_RESOLUTION, 0, -1.0, 1.0);
-  }
+  glOrtho (0.0, w, h, 0, -1.0, 1.0);
   glMatrixMode(GL_MODELVIEW);  
   glLoadIdentity(); 
+
+  // world follows the window, grid keeps its cell size
+  world_w = w;
+  world_h = h;
+  int cx = (int)((float)w / cell_size_x + 0.5f);
+  int cy = (int)((float)h / cell_size_y + 0.5f);
+  grid_cells_x = cx > 0 ? cx : 1;
+  grid_cells_y = cy > 0 ? cy : 1;
+  fit_grid();
+  for (int b=0; b<balls.count; b++)
+    clamp_ball (b);
+  narrow_band_reset (&meta_band);
+  memcpy (prev_x, balls.x, sizeof(prev_x));
+  memcpy (prev_y, balls.y, sizeof(prev_y));
 }
 void keyboard (unsigned char key, int x, int y) 
 {
@@ -1005,116 +602,154 @@ void keyboard (unsigned char key, int x, int y)
     case 'x':
       plain_circle = !plain_circle;
       break;
+    case 'a':
+      adaptive = !adaptive;
+      break;
+    case 'c':
+      cached = !cached;
+      break;
+    case 'o':
+      outlines = !outlines;
+      break;
+    case 's':
+      simplify = !simplify;
+      break;
+    case '3':
+      view3d = !view3d;
+      break;
+    case 'b':
+      bands = !bands;
+      break;
+    case 'n':
+      narrow = !narrow;
+      break;
+    case 'f':
+      capped = !capped && frame_cap > 0;
+      start_frames();
+      break;
     default: 
     break;
   }
 }
 
+bool parse_options (int argc, char *argv[])
+{
+  int cell_x = CELL_X, cell_y = CELL_Y;
+
+  volume_cells = VOLUME_CELLS;
+  sim_rate = SIM_RATE;
+  frame_cap = FRAME_CAP;
+  seed = SEED;
+  world_w = X_RESOLUTION;
+  world_h = Y_RESOLUTION;
+  for (int i=1; i<argc; i++)
+  {
+    if (strcmp (argv[i], "-w") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%dx%d", &world_w, &world_h) != 2 || world_w < 1 || world_h < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-g") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%dx%d", &cell_x, &cell_y) != 2 || cell_x < 1 || cell_y < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-v") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &volume_cells) != 1 || volume_cells < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-r") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &sim_rate) != 1 || sim_rate < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-f") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &frame_cap) != 1 || frame_cap < 0 || frame_cap > 1000)
+        return false;
+    }
+    else if (strcmp (argv[i], "-s") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%u", &seed) != 1)
+        return false;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  cell_size_x = (float)world_w / (float)cell_x;
+  cell_size_y = (float)world_h / (float)cell_y;
+  return true;
+}
+
 int main (int argc, char *argv[]) 
 {
-  // **************************
-  // * ball 1 characteristics *
-  // **************************
-    ball1.position.x = X_RESOLUTION / 2;
-    ball1.position.y = Y_RESOLUTION / 2,
-    ball1.position.z = 0;
-    ball1.position.direction = NORTH;
-    ball1.radius = 50;
-    ball1.color.r = 255;
-    ball1.color.g = 255;
-    ball1.color.b = 0;
-  // **************************
-  // * ball 2 characteristics *
-  // **************************
-    ball2.position.x = X_RESOLUTION / 2;
-    ball2.position.y = Y_RESOLUTION / 2;
-    ball2.position.z = 0;
-    ball2.position.direction = EAST;
-    ball2.radius = 50;
-    ball2.color.r = 255;
-    ball2.color.g = 255;
-    ball2.color.b = 0;
-  // **************************
-  // * ball 3 characteristics *
-  // **************************
-    ball3.position.x = X_RESOLUTION / 2;
-    ball3.position.y = Y_RESOLUTION / 2;
-    ball3.position.z = 0;
-    ball3.position.direction = SOUTH;
-    ball3.radius = 50;
-    ball3.color.r = 255;
-    ball3.color.g = 255;
-    ball3.color.b = 0;
-  // **************************
-  // * ball 4 characteristics *
-  // **************************
-    ball4.position.x = X_RESOLUTION / 2;
-    ball4.position.y = Y_RESOLUTION / 2;
-    ball4.position.z = 0;
-    ball4.position.direction = WEST;
-    ball4.radius = 50;
-    ball4.color.r = 255;
-    ball4.color.g = 255;
-    ball4.color.b = 0;
-  // **************************
-  // * ball 5 characteristics *
-  // **************************
-    ball5.position.x = X_RESOLUTION / 2;
-    ball5.position.y = Y_RESOLUTION / 2;
-    ball5.position.z = 0;
-    ball5.position.direction = NORTHEAST;
-    ball5.radius = 50;
-    ball5.color.r = 255;
-    ball5.color.g = 255;
-    ball5.color.b = 0;
-  // **************************
-  // * ball 6 characteristics *
-  // **************************
-    ball6.position.x = X_RESOLUTION / 2;
-    ball6.position.y = Y_RESOLUTION / 2;
-    ball6.position.z = 0;
-    ball6.position.direction = NORTHWEST;
-    ball6.radius = 50;
-    ball6.color.r = 255;
-    ball6.color.g = 255;
-    ball6.color.b = 0;
-  // **************************
-  // * ball 7 characteristics *
-  // **************************
-    ball7.position.x = X_RESOLUTION / 2;
-    ball7.position.y = Y_RESOLUTION / 2;
-    ball7.position.z = 0;
-    ball7.position.direction = SOUTHEAST;
-    ball7.radius = 50;
-    ball7.color.r = 255;
-    ball7.color.g = 255;
-    ball7.color.b = 0;
-  // **************************
-  // * ball 8 characteristics *
-  // **************************
-    ball8.position.x = X_RESOLUTION / 2;
-    ball8.position.y = Y_RESOLUTION / 2;
-    ball8.position.z = 0;
-    ball8.position.direction = SOUTHEAST;
-    ball8.radius = 50;
-    ball8.color.r = 255;
-    ball8.color.g = 255;
-    ball8.color.b = 0;
+  glutInit (&argc, argv);
+  if (!parse_options (argc, argv))
+  {
+    fprintf (stderr, "Usage: %s [-w WxH] [-g CXxCY] [-v N] [-r N] [-f N] [-s N]\n", argv[0]);
+    return 1;
+  }
+  field_grid_init (&grid);
+  // *****************************************************
+  // * balls start in the middle, heading 8 directions *
+  // *****************************************************
+  int directions[BALL_COUNT] = {NORTH, EAST, SOUTH, WEST, NORTHEAST, NORTHWEST, SOUTHEAST, SOUTHEAST};
+  ball_set_init (&balls);
+  if (!ball_set_resize (&balls, BALL_COUNT))
+  {
+    fprintf (stderr, "Cannot allocate %d balls\n", BALL_COUNT);
+    return 1;
+  }
+  for (int b=0; b<BALL_COUNT; b++)
+  {
+    balls.x[b] = world_w / 2;
+    balls.y[b] = world_h / 2;
+    balls.radius[b] = BALL_RADIUS;
+    balls.direction[b] = directions[b];
+  }
+  //
+  memcpy (prev_x, balls.x, sizeof(prev_x));
+  memcpy (prev_y, balls.y, sizeof(prev_y));
   //
   // seed the random number generator
-  srandom (time(0));
+  ball_set_seed (&balls, seed);
+  // simulation clock starts now, drawing capped unless -f 0
+  sim_accum = 0.0;
+  sim_clock = std::chrono::steady_clock::now();
+  capped = frame_cap > 0;
+  frame_timer_id = 0;
   // initialize control for drawing plain circle
   plain_circle = true;
+  init_circle();
   // initialize control for using Linear Interpolation
   linear_interp = true;
+  // full grid marching squares by default
+  adaptive = false;
+  quad_march_init (&adaptive_march);
+  // exact marching squares by default, 'c' re-emits only the cells that changed
+  cached = false;
+  march_cache_init (&meta_cache);
+  meta_vbo = 0;
+  // outlines off by default
+  outlines = false;
+  simplify = false;
+  // 2D metaballs by default, single level
+  view3d = false;
+  bands = false;
+  // every corner evaluated by default
+  narrow = false;
+  narrow_band_init (&meta_band);
 
-  glutInit (&argc, argv);
   glutInitDisplayMode (GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH); 
-  glutInitWindowSize (X_RESOLUTION, Y_RESOLUTION);
+  glutInitWindowSize (world_w, world_h);
   glutCreateWindow ("Marching Squares");
   glutDisplayFunc (display);  
   glutReshapeFunc (reshape);
   glutKeyboardFunc (keyboard);
+  start_frames();
   glutMainLoop();
 }
 
@@ -1,30 +1,84 @@
+/**Command line:
+ * -n N       particles of one explosion, and most alive at once, default 10000
+ * -t N       simulation threads, default one per hardware thread
+ * -a         analytic: one explosion drawn in closed form at the time shown, nothing stepped
+ * -half      one explosion stepped in packed storage (16 bit positions, half float velocities),
+ *            half the memory traffic of a step; not with -a
+ * -sort N    blending: depth sort every N new frames of the simulation, default 1
+ * Keys: space explodes (again), e toggles a fountain, f toggles forces (gravity, drag, an
+ * attractor above the cube and a vortex around the vertical axis), c toggles collisions
+ * between particles, b toggles alpha blending (particles fade out, drawn back to front),
+ * p points or triangles, Esc quits. With -a: [ and ] seek a second back and forth, r
+ * rewinds; with -a or -half there is no fountain, no forces, no collisions and no blending
+*/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#include <chrono>
 #ifdef __APPLE__
   #include <OpenGL/gl.h>
   #include <OpenGL/glu.h>
   #include <GLUT/glut.h>
 #elif __linux__
+  #define GL_GLEXT_PROTOTYPES
   #include <GL/gl.h>
   #include <GL/glut.h> 
 #endif
 
 //custom library
-#include "aclib/vec3.h"
 #include "aclib/aclib.h"
+#include "particle/particle_sim.h"
+#include "particle/depth_sort.h"
+#include "particle/particle_packed.h"
 
 //Constants
+//default particle count
 #define PARTICLES_NUM 10000
+//lifetime of a particle in steps
+#define PARTICLE_LIFE 200.0f
+//side of a particle triangle, and of a point in pixels
+#define PARTICLE_SIZE 0.01f
+#define PARTICLE_POINT_SIZE 2.0f
+//collision radius of a particle, and the speed kept along the hit
+#define PARTICLE_RADIUS 0.005f
+#define PARTICLE_RESTITUTION 0.5f
+//simulation steps per second, and the most one idle call may catch up
+#define SIM_RATE 60
+#define MAX_SIM_STEPS 8
+//seconds [ and ] seek in analytic mode
+#define SEEK_SECONDS 1.0
 
 
 //Global var:
 int   cube_exploded = 0;
 float angle = 0.0f; // camera rotation angle
-float particle_color = 1.0f; // particle color
-Vec3f* particleS = new Vec3f[PARTICLES_NUM]; //particle position S
-Vec3f* particleV = new Vec3f[PARTICLES_NUM]; //particle velocity V
+int particle_count = PARTICLES_NUM; //-n
+bool fountain = false; //continuous emission, 'e'
+bool forces_on = false; //gravity, drag, attractor and vortex, 'f'
+bool collisions_on = false; //particles bounce off each other, 'c'
+int sim_threads = 0; //-t, 0 for one per hardware thread
+bool analytic = false; //-a
+particle_set explosion; //analytic mode: the particles as emitted, never written after
+particle_emitter explosion_emitter; //analytic mode: source of every explosion
+double explosion_time = 0.0; //analytic mode: time shown, seconds after the explosion
+bool half = false; //-half
+particle_packed half_explosion; //-half: the explosion packed from explosion, stepped in idle
+int half_generation = 0; //-half: steps and bursts so far, to know when to pack again
+particle_sim sim; //particles, drawn from one buffer while the worker steps the other
+int particles_visible = 0; //live particles in the drawn buffer
+double sim_accum = 0.0; //time not simulated yet (second)
+std::chrono::steady_clock::time_point sim_clock; //monotonic time of the last idle call
+GLuint particle_vbo = 0; //vertices of every visible particle, refilled when the front buffer changes
+int particle_vertices = 0; //vertices in particle_vbo
+int packed_generation = -1; //front buffer generation and mode particle_vbo holds
+bool packed_points = false;
+bool particle_points = false; //GL_POINTS instead of triangles, 'p'
+bool particle_blend = false; //alpha blended back to front, 'b'
+bool packed_blend = false;
+int sort_every = 1; //-sort
+particle_depth_order depth_order; //back to front order of the drawn buffer
 
 //function header
 void display (void);
@@ -34,13 +88,18 @@ void idle (void);
 void explode_cube (void);
 //init lighting
 void init(void);
-//init particles data and srand
+//init the particle pool and its emitter, and start the simulation worker (analytic mode: the explosion set,
+//-half: the explosion set and its packed storage)
 void particleInit(void);
-//RNGesus
-float nextRand(void);
+//forces of the 'f' key, or none
+void setForces(bool on);
+//parse the command line, see the top of the file. false on bad option
+bool parseOptions(int argc, char *argv[]);
+//fixed timestep: number of simulation steps the monotonic clock is due
+int dueSteps(void);
 //draw spinning cube
 void drawCube(void);
-//draw Particles
+//draw Particles: every visible one from particle_vbo in one draw call
 void drawParticles(void);
 
 void init(void)
@@ -78,24 +137,110 @@ void init(void)
   glEnable (GL_NORMALIZE);
 }
 
-float nextRand(void)
+void particleInit(void)
 {
-  //0.00001f to 0.10001f
-  float ans = (float)rand()/(float)(RAND_MAX/0.1f)+0.00001f;
-  // 50% +, 50% -
-  if (rand()%2 == 1)
-    ans *= -1.0;
-  return ans;
+  particle_emitter emitter;
+
+  particle_emitter_init (&emitter, (unsigned int)time(NULL));
+  emitter.life = PARTICLE_LIFE;
+  particle_depth_init (&depth_order);
+  if (analytic || half)
+  {
+    explosion_emitter = emitter;
+    particle_set_init (&explosion);
+    particle_packed_init (&half_explosion);
+    if (!particle_set_resize (&explosion, particle_count) ||
+        (half && !particle_packed_resize (&half_explosion, particle_count)))
+    {
+      fprintf (stderr, "Cannot allocate %d particles\n", particle_count);
+      exit (1);
+    }
+  }
+  else if (!particle_sim_open (&sim, particle_count, &emitter, sim_threads))
+  {
+    fprintf (stderr, "Cannot allocate %d particles\n", particle_count);
+    exit (1);
+  }
 }
 
-void particleInit(void)
+void setForces(bool on)
+{
+  particle_forces forces;
+
+  particle_forces_init (&forces);
+  if (on)
+  {
+    forces.gy = -0.0005f;
+    forces.drag = 0.005f;
+    forces.drag2 = 0.5f;
+    forces.attractors = 1;
+    forces.attractor[0].x = 0.0f;
+    forces.attractor[0].y = 3.0f;
+    forces.attractor[0].z = 0.0f;
+    forces.attractor[0].strength = 0.002f;
+    forces.attractor[0].soften = 0.25f;
+    forces.vortices = 1;
+    forces.vortex[0].x = forces.vortex[0].y = forces.vortex[0].z = 0.0f;
+    forces.vortex[0].ax = forces.vortex[0].az = 0.0f;
+    forces.vortex[0].ay = 1.0f;
+    forces.vortex[0].strength = 0.002f;
+    forces.vortex[0].soften = 0.25f;
+  }
+  particle_sim_forces (&sim, &forces);
+}
+
+bool parseOptions(int argc, char *argv[])
+{
+  for (int i=1; i<argc; i++)
+  {
+    if (strcmp (argv[i], "-n") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &particle_count) != 1 || particle_count < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-t") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &sim_threads) != 1 || sim_threads < 1)
+        return false;
+    }
+    else if (strcmp (argv[i], "-a") == 0)
+    {
+      analytic = true;
+    }
+    else if (strcmp (argv[i], "-half") == 0)
+    {
+      half = true;
+    }
+    else if (strcmp (argv[i], "-sort") == 0 && i+1 < argc)
+    {
+      if (sscanf (argv[++i], "%d", &sort_every) != 1 || sort_every < 1)
+        return false;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return !(analytic && half);
+}
+
+int dueSteps(void)
 {
-  srand((unsigned int)time(NULL));
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double step = 1.0 / SIM_RATE;
+  int steps = 0;
 
-  for(int i=0; i<PARTICLES_NUM; i++) {
-    particleS[i] = Vec3f();
-    particleV[i] = Vec3f(nextRand(),nextRand(),nextRand());
+  sim_accum += std::chrono::duration<double>(now - sim_clock).count();
+  sim_clock = now;
+  while (sim_accum >= step && steps < MAX_SIM_STEPS)
+  {
+    sim_accum -= step;
+    steps++;
   }
+  // too far behind: drop the backlog instead of snowballing
+  if (sim_accum >= step)
+    sim_accum = 0.0;
+  return steps;
 }
 
 void drawCube(void)
@@ -115,26 +260,79 @@ void drawCube(void)
 
 void drawParticles(void)
 {
-  
-  if (particle_color > 0.0f)
+  // analytic mode has no stepped state: every frame is packed for its own time
+  int count = analytic ? explosion.count : (half ? half_explosion.count : particles_visible);
+  int generation = half ? half_generation : sim.generation;
+  if (count <= 0)
+    return;
+  if (particle_vbo == 0)
+    glGenBuffers (1, &particle_vbo);
+  glBindBuffer (GL_ARRAY_BUFFER, particle_vbo);
+  if (analytic || packed_generation != generation || packed_points != particle_points ||
+      packed_blend != particle_blend)
   {
-    glColor3f (particle_color, particle_color, 0.0f);
-    for (int i=0; i<PARTICLES_NUM; i++)
+    // finished buffer only, the worker is stepping the other one
+    const particle_set* particles = analytic || half ? &explosion : particle_sim_front (&sim);
+    int per = particle_points ? 1 : 3;
+    // orphan the old storage: the driver hands out fresh memory instead of waiting for the GPU to finish reading
+    glBufferData (GL_ARRAY_BUFFER, (GLsizeiptr)count * per * sizeof(particle_vertex), NULL, GL_STREAM_DRAW);
+    particle_vertex* out = (particle_vertex*) glMapBuffer (GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    particle_vertices = 0;
+    packed_generation = -1;
+    if (out != NULL)
     {
-      glPushMatrix();
-        glTranslatef (particleS[i].x, particleS[i].y, particleS[i].z);
-        glNormal3f(0.0f, 0.0f, 1.0f);
-        glBegin(GL_TRIANGLES);
-          glVertex3f(0.01f, 0.0f, 0.0f);
-          glVertex3f(0.01f, 0.01f, 0.0f);
-          glVertex3f(0.0f, 0.01f, 0.0f);
-        glEnd();
-
-      glPopMatrix();
-      particleS[i] = particleS[i] + particleV[i];
+      if (analytic)
+        particle_vertices = particle_set_pack_at (particles, (float)(explosion_time * SIM_RATE), !particle_points,
+                                                  PARTICLE_SIZE, out, 0);
+      else if (half)
+        particle_vertices = particle_packed_pack (&half_explosion, !particle_points, PARTICLE_SIZE, out, 0);
+      else if (particle_blend)
+      {
+        // eye space z is row 2 of the modelview; the most negative is the farthest
+        GLfloat m[16];
+        glGetFloatv (GL_MODELVIEW_MATRIX, m);
+        float axis[3] = {m[2], m[6], m[10]};
+        particle_depth_sort (&depth_order, particles, axis, sort_every, 0);
+        particle_vertices = particle_depth_pack (&depth_order, particles, !particle_points, PARTICLE_SIZE, out, 0);
+      }
+      else
+      {
+        particle_vertices = particle_set_pack (particles, !particle_points, PARTICLE_SIZE, out, 0);
+      }
+      if (glUnmapBuffer (GL_ARRAY_BUFFER))
+      {
+        packed_generation = generation;
+        packed_points = particle_points;
+        packed_blend = particle_blend;
+      }
+      else
+      {
+        particle_vertices = 0;
+      }
     }
   }
-  
+  if (particle_vertices > 0)
+  {
+    glNormal3f (0.0f, 0.0f, 1.0f);
+    glPointSize (PARTICLE_POINT_SIZE);
+    glInterleavedArrays (GL_C4UB_V3F, 0, (const GLvoid*)0);
+    if (packed_blend)
+    {
+      // sorted back to front, so no depth writes needed among the particles
+      glEnable (GL_BLEND);
+      glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      glDepthMask (GL_FALSE);
+    }
+    glDrawArrays (particle_points ? GL_POINTS : GL_TRIANGLES, 0, particle_vertices);
+    if (packed_blend)
+    {
+      glDepthMask (GL_TRUE);
+      glDisable (GL_BLEND);
+    }
+    glDisableClientState (GL_COLOR_ARRAY);
+    glDisableClientState (GL_VERTEX_ARRAY);
+  }
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
 }
 
 void display (void)
@@ -167,11 +365,54 @@ void keyboard (unsigned char key, int x, int y)
       // exit (0);
     break;
     case 27:
-      delete [] particleS;
-      delete [] particleV;
+      if (analytic || half)
+      {
+        particle_set_free (&explosion);
+        particle_packed_free (&half_explosion);
+      }
+      else
+        particle_sim_close (&sim);
+      glDeleteBuffers (1, &particle_vbo);
+      particle_depth_free (&depth_order);
       exit (0);
     break;
-    case 'r':
+    case 'r': //rewind
+      explosion_time = 0.0;
+    break;
+    case '[': //seek, the closed form draws any time as cheaply as the next
+      explosion_time = explosion_time > SEEK_SECONDS ? explosion_time - SEEK_SECONDS : 0.0;
+    break;
+    case ']':
+      explosion_time += SEEK_SECONDS;
+    break;
+    case 'p': //points or triangles
+      particle_points = !particle_points;
+    break;
+    case 'e': //fountain: as many per lifetime as the pool holds
+      if (analytic || half)
+        break;
+      fountain = !fountain;
+      particle_sim_rate (&sim, fountain ? particle_count / PARTICLE_LIFE : 0.0f);
+      if (!cube_exploded)
+        explode_cube();
+    break;
+    case 'f': //forces, all applied in the one step pass
+      if (analytic || half)
+        break;
+      forces_on = !forces_on;
+      setForces (forces_on);
+    break;
+    case 'b': //alpha blending, depth sorted
+      if (analytic || half)
+        break;
+      particle_blend = !particle_blend;
+      particle_depth_init (&depth_order); // full sort on the next pack
+    break;
+    case 'c': //collisions, on a grid sorted every step
+      if (analytic || half)
+        break;
+      collisions_on = !collisions_on;
+      particle_sim_collisions (&sim, collisions_on ? PARTICLE_RADIUS : 0.0f, PARTICLE_RESTITUTION);
     break;
   }
 }
@@ -188,13 +429,59 @@ void reshape (int w, int h)
 void idle (void)
 {
   angle += 0.3;  /* Always continue to rotate the camera */
-  if (cube_exploded)
-    particle_color -= 0.005f;
+  // swap in the finished step and queue the ones due; they run while this frame draws
+  if (cube_exploded && analytic)
+  {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    explosion_time += std::chrono::duration<double>(now - sim_clock).count();
+    sim_clock = now;
+  }
+  else if (cube_exploded && half)
+  {
+    // stepped here, in place: the packed step is cheap enough not to need the worker
+    for (int steps = dueSteps(); steps > 0 && half_explosion.count > 0; steps--)
+    {
+      particle_packed_step (&half_explosion, sim_threads);
+      half_generation++;
+    }
+  }
+  else if (cube_exploded)
+  {
+    particles_visible = particle_sim_advance (&sim, dueSteps());
+  }
   glutPostRedisplay ();
 }
 
 void explode_cube(void)
 {
+  // a new burst joins the particles still alive, as far as the pool has room;
+  // in analytic mode it replaces the old one, the closed form holds for one burst only;
+  // so it does with -half, whose box only holds the reach of one burst
+  if (analytic || half)
+  {
+    particle_set_clear (&explosion);
+    explosion_emitter.burst = particle_count;
+    particle_emit (&explosion, &explosion_emitter);
+    explosion_time = 0.0;
+    if (half)
+    {
+      // the farthest a particle gets in its life, a little over
+      float reach = explosion_emitter.speed * 1.0001f * PARTICLE_LIFE * 1.01f;
+      float lo[3] = {explosion_emitter.x - reach, explosion_emitter.y - reach, explosion_emitter.z - reach};
+      float hi[3] = {explosion_emitter.x + reach, explosion_emitter.y + reach, explosion_emitter.z + reach};
+      particle_packed_encode (&half_explosion, &explosion, lo, hi);
+      half_generation++;
+    }
+  }
+  else
+  {
+    particle_sim_burst (&sim, particle_count);
+  }
+  if (!cube_exploded)
+  {
+    sim_accum = 0.0;
+    sim_clock = std::chrono::steady_clock::now();
+  }
   cube_exploded = 1;
   printf ("BOOM!\n");
 }
@@ -205,6 +492,11 @@ void explode_cube(void)
 int main (int argc, char *argv[])
 {
   glutInit (&argc, argv);
+  if (!parseOptions (argc, argv))
+  {
+    fprintf (stderr, "Usage: %s [-n particles] [-t threads] [-a | -half] [-sort frames]\n", argv[0]);
+    return 1;
+  }
   glutInitWindowPosition (0, 0);
   glutInitWindowSize (1280, 1024);
   glutInitDisplayMode (GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
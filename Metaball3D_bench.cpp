@@ -0,0 +1,91 @@
+/**Author: Un Hou (Albert) Chan
+ * Headless benchmark for the 3D metaballs (marching cubes), no window needed.
+ * Runs the 8 balls of project 1 with the same bouncing movement, spread in depth,
+ * and times the polygonizer at 128^3 and 256^3 cubes, single thread and all threads.
+ *
+ * Usage: metaball3d_bench [-f frames] [-t threads]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "metaball/ball.h"
+#include "metaball/march3d.h"
+#include "aclib/parallel.h"
+
+//world the balls bounce in, cube so every axis gets the same resolution
+#define WORLD_SIZE 600
+#define BALL_COUNT 8
+#define ISO_THRESHOLD 1.0f
+
+int main (int argc, char *argv[])
+{
+  int frames = 20;
+  int threads = aclib::hardware_threads();
+  for (int i=1; i<argc; i++)
+  {
+    if (strcmp (argv[i], "-f") == 0 && i+1 < argc)
+      frames = atoi (argv[++i]);
+    else if (strcmp (argv[i], "-t") == 0 && i+1 < argc)
+      threads = atoi (argv[++i]);
+    else
+    {
+      fprintf (stderr, "Usage: %s [-f frames] [-t threads]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1)
+    frames = 1;
+
+  int sizes[2] = {128, 256};
+  int thread_counts[2] = {1, threads};
+  printf ("%8s %8s %12s %12s %12s\n", "cubes", "threads", "ms/frame", "triangles", "Mcubes/s");
+  for (int s=0; s<2; s++)
+    for (int t=0; t<2; t++)
+    {
+      if (t == 1 && threads == 1)
+        continue;
+      //same start as project 1: all balls in the middle, 8 directions; fixed seed for repeatable runs
+      int directions[BALL_COUNT] = {NORTH, EAST, SOUTH, WEST, NORTHEAST, NORTHWEST, SOUTHEAST, SOUTHEAST};
+      float bx[BALL_COUNT], by[BALL_COUNT], bz[BALL_COUNT], br2[BALL_COUNT];
+      ball_set balls;
+      ball_set_init (&balls);
+      ball_set_resize (&balls, BALL_COUNT);
+      for (int b=0; b<BALL_COUNT; b++)
+      {
+        balls.x[b] = WORLD_SIZE / 2;
+        balls.y[b] = WORLD_SIZE / 2;
+        balls.radius[b] = 50;
+        balls.direction[b] = directions[b];
+        bz[b] = (float)(WORLD_SIZE * (b + 1) / (BALL_COUNT + 1));
+        br2[b] = 50.0f * 50.0f;
+      }
+      ball_set_seed (&balls, 1);
+
+      volume_grid vol = {sizes[s], sizes[s], sizes[s], WORLD_SIZE, WORLD_SIZE, WORLD_SIZE};
+      mesh3d mesh;
+      double total_ms = 0.0;
+      size_t tris = 0;
+      for (int f=0; f<frames; f++)
+      {
+        ball_set_move (&balls, WORLD_SIZE, WORLD_SIZE);
+        for (int b=0; b<BALL_COUNT; b++)
+        {
+          bx[b] = (float)balls.x[b];
+          by[b] = (float)balls.y[b];
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        march3d_volume (&vol, bx, by, bz, br2, BALL_COUNT, ISO_THRESHOLD, thread_counts[t], &mesh);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        total_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        tris += mesh.index.size() / 3;
+      }
+      double ms = total_ms / frames;
+      double cubes = (double)sizes[s] * sizes[s] * sizes[s];
+      ball_set_free (&balls);
+      printf ("%5d^3 %8d %12.2f %12zu %12.1f\n", sizes[s], thread_counts[t], ms, tris / frames, cubes / (ms * 1000.0));
+    }
+  return 0;
+}
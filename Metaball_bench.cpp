@@ -0,0 +1,315 @@
+/**Author: Un Hou (Albert) Chan
+ * Scaling benchmark of the project 1 pipeline, no window needed.
+ * Sweeps ball counts, marching squares grids, Linear Interpolation on/off and thread
+ * counts, and times the three stages of a frame separately: ball movement, field
+ * evaluation and marching squares (contour). Runs are seeded, so the same options give
+ * the same balls and the same bounces on every commit.
+ *
+ * The balls start at seeded random places and directions in an 800x600 world. The radius
+ * shrinks as the count grows (50 * sqrt(8 / balls)) so the balls cover about the same
+ * area and the contour stays meaningful. Field cost is balls * corners; a run above the
+ * budget is skipped (reported with skipped=1) rather than left to run for hours.
+ *
+ * Usage: metaball_bench [-b list] [-g list] [-t list] [-n frames] [-s seed] [-budget N] [-fused] [-csv file] [-json file]
+ * -b list    ball counts, default 8,100,1000,10000,100000
+ * -g list    grids, default 40x30,160x120,640x480,1024x1024,4096x4096
+ * -t list    field threads, default 1 and one per hardware thread
+ * -n N       timed frames per run, default 10, after one untimed warm up frame
+ * -s N       random seed, default 1
+ * -budget N  largest balls * corners per frame to run, default 2e9
+ * -fused     field and classification in one pass (metaball/classify.h): the field column
+ *            times classify_field, the contour column classify_triangles. Single thread
+ * -csv file  results as CSV, - for stdout
+ * -json file results as a JSON array, - for stdout
+ * Without -csv or -json a table is printed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "metaball/ball.h"
+#include "metaball/field.h"
+#include "metaball/march.h"
+#include "metaball/classify.h"
+#include "aclib/parallel.h"
+
+#define X_RESOLUTION 800
+#define Y_RESOLUTION 600
+#define ISO_THRESHOLD 1.0f
+//radius at the 8 balls of project 1
+#define BALL_RADIUS 50
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**int balls, cell_x, cell_y, threads; what was run
+ * bool linear_interp, fused;
+ * bool skipped; over the budget, nothing timed
+ * double move_ms, field_ms, contour_ms; per frame
+ * double triangles; per frame
+*/
+typedef struct bench_result
+{
+  int balls;
+  int cell_x;
+  int cell_y;
+  bool linear_interp;
+  bool fused;
+  int threads;
+  bool skipped;
+  double move_ms;
+  double field_ms;
+  double contour_ms;
+  double triangles;
+} bench_result;
+
+static double elapsed_ms (bench_clock::time_point t0, bench_clock::time_point t1)
+{
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+/**Comma separated positive integers
+*/
+static bool parse_ints (const char* text, std::vector<int>* out)
+{
+  out->clear();
+  while (*text != '\0')
+  {
+    char* end;
+    long v = strtol (text, &end, 10);
+    if (end == text || v < 1 || (*end != ',' && *end != '\0'))
+      return false;
+    out->push_back ((int)v);
+    text = *end == ',' ? end + 1 : end;
+  }
+  return !out->empty();
+}
+
+/**Comma separated CXxCY pairs
+*/
+static bool parse_grids (const char* text, std::vector<int>* out)
+{
+  out->clear();
+  while (*text != '\0')
+  {
+    int cx, cy, used;
+    if (sscanf (text, "%dx%d%n", &cx, &cy, &used) != 2 || cx < 1 || cy < 1)
+      return false;
+    out->push_back (cx);
+    out->push_back (cy);
+    text += used;
+    if (*text == ',')
+      text++;
+    else if (*text != '\0')
+      return false;
+  }
+  return !out->empty();
+}
+
+/**Seeded start: random centers and directions, radius scaled to the count
+*/
+static void place_balls (ball_set* balls, unsigned int seed)
+{
+  unsigned int s = seed * 2654435761u + 0x9e3779b9u;
+  int radius = (int)lrint (BALL_RADIUS * sqrt (8.0 / balls->count));
+
+  if (s == 0)
+    s = 1;
+  if (radius < 1)
+    radius = 1;
+  for (int b=0; b<balls->count; b++)
+  {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    balls->x[b] = (int)(s % X_RESOLUTION);
+    balls->y[b] = (int)((s >> 10) % Y_RESOLUTION);
+    balls->direction[b] = (int)(s >> 29);
+    balls->radius[b] = radius;
+  }
+  ball_set_seed (balls, seed);
+}
+
+static void run (bench_result* r, int frames, unsigned int seed)
+{
+  ball_set balls;
+  field_grid grid;
+  std::vector<float> bx (r->balls), by (r->balls), br2 (r->balls);
+  std::vector<float> tris;
+  cell_list cells;
+
+  ball_set_init (&balls);
+  field_grid_init (&grid);
+  if (!ball_set_resize (&balls, r->balls) ||
+      (!r->fused && !field_grid_resize (&grid, r->cell_x, r->cell_y, (float)X_RESOLUTION, (float)Y_RESOLUTION)))
+  {
+    fprintf (stderr, "Cannot allocate %d balls with %dx%d cells\n", r->balls, r->cell_x, r->cell_y);
+    r->skipped = true;
+    ball_set_free (&balls);
+    return;
+  }
+  place_balls (&balls, seed);
+  r->move_ms = r->field_ms = r->contour_ms = r->triangles = 0.0;
+  //frame -1 warms the caches and sizes the triangle buffer
+  for (int f=-1; f<frames; f++)
+  {
+    bench_clock::time_point t0 = bench_clock::now();
+    ball_set_move (&balls, X_RESOLUTION, Y_RESOLUTION);
+    for (int b=0; b<r->balls; b++)
+    {
+      bx[b] = (float)balls.x[b];
+      by[b] = (float)balls.y[b];
+      br2[b] = (float)(balls.radius[b] * balls.radius[b]);
+    }
+    bench_clock::time_point t1 = bench_clock::now();
+    if (r->fused)
+      classify_field (&cells, r->cell_x, r->cell_y, (float)X_RESOLUTION, (float)Y_RESOLUTION,
+                      &bx[0], &by[0], &br2[0], r->balls, ISO_THRESHOLD, r->linear_interp);
+    else
+      field_grid_eval_threads (&grid, &bx[0], &by[0], &br2[0], r->balls, r->threads);
+    bench_clock::time_point t2 = bench_clock::now();
+    if (r->fused)
+      classify_triangles (&cells, &tris);
+    else
+      march_grid (&grid, ISO_THRESHOLD, r->linear_interp, &tris);
+    bench_clock::time_point t3 = bench_clock::now();
+    if (f < 0)
+      continue;
+    r->move_ms += elapsed_ms (t0, t1);
+    r->field_ms += elapsed_ms (t1, t2);
+    r->contour_ms += elapsed_ms (t2, t3);
+    r->triangles += (double)(tris.size() / 6);
+  }
+  r->move_ms /= frames;
+  r->field_ms /= frames;
+  r->contour_ms /= frames;
+  r->triangles /= frames;
+  field_grid_free (&grid);
+  ball_set_free (&balls);
+}
+
+static FILE* open_output (const char* path)
+{
+  if (path == NULL)
+    return NULL;
+  if (strcmp (path, "-") == 0)
+    return stdout;
+  return fopen (path, "w");
+}
+
+static bool close_output (FILE* file)
+{
+  if (file == NULL || file == stdout)
+    return file == NULL || fflush (file) == 0;
+  return fclose (file) == 0;
+}
+
+int main (int argc, char *argv[])
+{
+  std::vector<int> ball_counts, grids, thread_counts;
+  int frames = 10;
+  unsigned int seed = 1;
+  double budget = 2e9;
+  const char* csv_path = NULL;
+  const char* json_path = NULL;
+  bool fused = false;
+
+  parse_ints ("8,100,1000,10000,100000", &ball_counts);
+  parse_grids ("40x30,160x120,640x480,1024x1024,4096x4096", &grids);
+  thread_counts.push_back (1);
+  if (aclib::hardware_threads() > 1)
+    thread_counts.push_back (aclib::hardware_threads());
+  for (int i=1; i<argc; i++)
+  {
+    bool ok = true;
+    if (strcmp (argv[i], "-b") == 0 && i+1 < argc)
+      ok = parse_ints (argv[++i], &ball_counts);
+    else if (strcmp (argv[i], "-g") == 0 && i+1 < argc)
+      ok = parse_grids (argv[++i], &grids);
+    else if (strcmp (argv[i], "-t") == 0 && i+1 < argc)
+      ok = parse_ints (argv[++i], &thread_counts);
+    else if (strcmp (argv[i], "-n") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%d", &frames) == 1 && frames > 0;
+    else if (strcmp (argv[i], "-s") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%u", &seed) == 1;
+    else if (strcmp (argv[i], "-budget") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%lf", &budget) == 1 && budget > 0.0;
+    else if (strcmp (argv[i], "-fused") == 0)
+      fused = true;
+    else if (strcmp (argv[i], "-csv") == 0 && i+1 < argc)
+      csv_path = argv[++i];
+    else if (strcmp (argv[i], "-json") == 0 && i+1 < argc)
+      json_path = argv[++i];
+    else
+      ok = false;
+    if (!ok)
+    {
+      fprintf (stderr, "Usage: %s [-b list] [-g list] [-t list] [-n frames] [-s seed] [-budget N] [-fused] [-csv file] [-json file]\n", argv[0]);
+      return 1;
+    }
+  }
+  FILE* csv = open_output (csv_path);
+  FILE* json = open_output (json_path);
+  if ((csv_path != NULL && csv == NULL) || (json_path != NULL && json == NULL))
+  {
+    fprintf (stderr, "Cannot create %s\n", csv_path != NULL && csv == NULL ? csv_path : json_path);
+    return 1;
+  }
+  bool table = csv == NULL && json == NULL;
+  //the fused pass is single threaded
+  if (fused)
+    thread_counts.assign (1, 1);
+
+  if (table)
+    printf ("%8s %11s %6s %7s %10s %10s %10s %12s\n", "balls", "cells", "interp", "threads", "move ms", "field ms", "contour ms", "triangles");
+  if (csv != NULL)
+    fprintf (csv, "balls,cell_x,cell_y,linear_interp,fused,threads,frames,seed,skipped,move_ms,field_ms,contour_ms,triangles\n");
+  if (json != NULL)
+    fprintf (json, "[\n");
+  bool first = true;
+  for (size_t b=0; b<ball_counts.size(); b++)
+    for (size_t g=0; g<grids.size(); g+=2)
+      for (int interp=1; interp>=0; interp--)
+        for (size_t t=0; t<thread_counts.size(); t++)
+        {
+          bench_result r;
+          memset (&r, 0, sizeof(r));
+          r.balls = ball_counts[b];
+          r.cell_x = grids[g];
+          r.cell_y = grids[g+1];
+          r.linear_interp = interp == 1;
+          r.fused = fused;
+          r.threads = thread_counts[t];
+          r.skipped = (double)r.balls * (r.cell_x + 1) * (r.cell_y + 1) > budget;
+          if (!r.skipped)
+            run (&r, frames, seed);
+
+          if (table && r.skipped)
+            printf ("%8d %5dx%-5d %6s %7d %10s\n", r.balls, r.cell_x, r.cell_y, r.linear_interp ? "on" : "off", r.threads, "skipped");
+          else if (table)
+            printf ("%8d %5dx%-5d %6s %7d %10.4f %10.4f %10.4f %12.0f\n", r.balls, r.cell_x, r.cell_y,
+                    r.linear_interp ? "on" : "off", r.threads, r.move_ms, r.field_ms, r.contour_ms, r.triangles);
+          if (csv != NULL)
+            fprintf (csv, "%d,%d,%d,%d,%d,%d,%d,%u,%d,%.6f,%.6f,%.6f,%.1f\n", r.balls, r.cell_x, r.cell_y, r.linear_interp ? 1 : 0,
+                     r.fused ? 1 : 0, r.threads, frames, seed, r.skipped ? 1 : 0, r.move_ms, r.field_ms, r.contour_ms, r.triangles);
+          if (json != NULL)
+            fprintf (json, "%s  {\"balls\": %d, \"cell_x\": %d, \"cell_y\": %d, \"linear_interp\": %s, \"fused\": %s, \"threads\": %d, \"frames\": %d, "
+                     "\"seed\": %u, \"skipped\": %s, \"move_ms\": %.6f, \"field_ms\": %.6f, \"contour_ms\": %.6f, \"triangles\": %.1f}",
+                     first ? "" : ",\n", r.balls, r.cell_x, r.cell_y, r.linear_interp ? "true" : "false", r.fused ? "true" : "false", r.threads, frames,
+                     seed, r.skipped ? "true" : "false", r.move_ms, r.field_ms, r.contour_ms, r.triangles);
+          first = false;
+          if (table)
+            fflush (stdout);
+        }
+  if (json != NULL)
+    fprintf (json, "\n]\n");
+  if (!close_output (csv) || !close_output (json))
+  {
+    fprintf (stderr, "Cannot write the results\n");
+    return 1;
+  }
+  return 0;
+}
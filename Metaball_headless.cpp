@@ -0,0 +1,241 @@
+/**Author: Un Hou (Albert) Chan
+ * Headless metaballs: the project 1 pipeline (ball movement, field, marching squares)
+ * rasterized on the CPU into an RGBA buffer, no window or OpenGL needed.
+ * Frames are written as PPM or raw RGBA, or only timed when no output is given.
+ * The contours can be streamed out as vector data as well, on a writer thread.
+ *
+ * Usage: metaball_headless [-w WxH] [-g CXxCY] [-n frames] [-s seed] [-t threads] [-z] [-band] [-fused] [-field] [-raw] [-o pattern]
+ *                          [-c file] [-svg pattern] [-wait]
+ * -w WxH     image size, default 800x600
+ * -g CXxCY   marching squares cells, default 40x30
+ * -n N       frames, default 300. One simulation step per frame
+ * -s N       random seed, default 1
+ * -t N       raster threads, default one per hardware thread
+ * -z         crossings at edge midpoints instead of Linear Interpolation
+ * -band      narrow-band field evaluation, see metaball/narrow_band.h
+ * -fused     evaluate and classify in one pass (two rows live, no field grid), see metaball/classify.h
+ * -field     threshold the field at every pixel instead of filling marching squares triangles
+ * -raw       write bare width*height*4 bytes RGBA instead of PPM
+ * -o pattern printf pattern of the frame files, e.g. frames/meta%04d.ppm
+ * -c file    binary contour stream, see metaball/contour_export.h
+ * -svg pattern  printf pattern of per frame SVG contours, e.g. svg/meta%04d.svg
+ * -wait      wait for the writer when it falls behind instead of dropping contour frames
+ *            (dropped frames are counted and reported)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "metaball/ball.h"
+#include "metaball/field.h"
+#include "metaball/march.h"
+#include "metaball/raster.h"
+#include "metaball/contour.h"
+#include "metaball/contour_export.h"
+#include "metaball/narrow_band.h"
+#include "metaball/classify.h"
+#include "aclib/parallel.h"
+
+#define X_RESOLUTION 800
+#define Y_RESOLUTION 600
+#define CELL_X 40
+#define CELL_Y 30
+#define ISO_THRESHOLD 1.0f
+#define BALL_COUNT 8
+#define BALL_RADIUS 50
+//contour frames that may wait for the writer thread
+#define EXPORT_QUEUE 8
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms (bench_clock::time_point t0, bench_clock::time_point t1)
+{
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+int main (int argc, char *argv[])
+{
+  int width = X_RESOLUTION, height = Y_RESOLUTION;
+  int cell_x = CELL_X, cell_y = CELL_Y;
+  int frames = 300;
+  unsigned int seed = 1;
+  int threads = aclib::hardware_threads();
+  bool linear_interp = true, narrow = false, fused = false, field_mode = false, raw = false;
+  const char* pattern = NULL;
+  const char* contour_path = NULL;
+  const char* svg_pattern = NULL;
+  bool drop = true;
+
+  for (int i=1; i<argc; i++)
+  {
+    bool ok = true;
+    if (strcmp (argv[i], "-w") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+    else if (strcmp (argv[i], "-g") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%dx%d", &cell_x, &cell_y) == 2 && cell_x > 0 && cell_y > 0;
+    else if (strcmp (argv[i], "-n") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%d", &frames) == 1 && frames > 0;
+    else if (strcmp (argv[i], "-s") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%u", &seed) == 1;
+    else if (strcmp (argv[i], "-t") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%d", &threads) == 1 && threads > 0;
+    else if (strcmp (argv[i], "-z") == 0)
+      linear_interp = false;
+    else if (strcmp (argv[i], "-band") == 0)
+      narrow = true;
+    else if (strcmp (argv[i], "-fused") == 0)
+      fused = true;
+    else if (strcmp (argv[i], "-field") == 0)
+      field_mode = true;
+    else if (strcmp (argv[i], "-raw") == 0)
+      raw = true;
+    else if (strcmp (argv[i], "-o") == 0 && i+1 < argc)
+      pattern = argv[++i];
+    else if (strcmp (argv[i], "-c") == 0 && i+1 < argc)
+      contour_path = argv[++i];
+    else if (strcmp (argv[i], "-svg") == 0 && i+1 < argc)
+      svg_pattern = argv[++i];
+    else if (strcmp (argv[i], "-wait") == 0)
+      drop = false;
+    else
+      ok = false;
+    if (!ok)
+    {
+      fprintf (stderr, "Usage: %s [-w WxH] [-g CXxCY] [-n frames] [-s seed] [-t threads] [-z] [-band] [-fused] [-field] [-raw] [-o pattern] [-c file] [-svg pattern] [-wait]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  field_grid grid;
+  narrow_band band;
+  frame_buffer fb;
+  ball_set balls;
+  field_grid_init (&grid);
+  narrow_band_init (&band);
+  frame_buffer_init (&fb);
+  ball_set_init (&balls);
+  if (!field_grid_resize (&grid, cell_x, cell_y, (float)width, (float)height) ||
+      !frame_buffer_resize (&fb, width, height) || !ball_set_resize (&balls, BALL_COUNT))
+  {
+    fprintf (stderr, "Cannot allocate %dx%d frame with %dx%d cells\n", width, height, cell_x, cell_y);
+    return 1;
+  }
+  //same start as project 1: all balls in the middle, 8 directions
+  int directions[BALL_COUNT] = {NORTH, EAST, SOUTH, WEST, NORTHEAST, NORTHWEST, SOUTHEAST, SOUTHEAST};
+  for (int b=0; b<BALL_COUNT; b++)
+  {
+    balls.x[b] = width / 2;
+    balls.y[b] = height / 2;
+    balls.radius[b] = BALL_RADIUS;
+    balls.direction[b] = directions[b];
+  }
+  ball_set_seed (&balls, seed);
+  bool exporting = contour_path != NULL || svg_pattern != NULL;
+  //the contour export stitches lines from the field grid
+  fused = fused && !exporting && !field_mode;
+  contour_export exporter;
+  contour_set outline;
+  cell_list cells;
+  if (exporting && !contour_export_open (&exporter, contour_path, svg_pattern, (float)width, (float)height, EXPORT_QUEUE, drop))
+  {
+    fprintf (stderr, "Cannot create %s\n", contour_path);
+    return 1;
+  }
+
+  float bx[BALL_COUNT], by[BALL_COUNT], br2[BALL_COUNT];
+  std::vector<float> tris;
+  std::vector<char> path;
+  double move_ms = 0.0, field_ms = 0.0, march_ms = 0.0, raster_ms = 0.0, write_ms = 0.0, export_ms = 0.0;
+  size_t total_tris = 0;
+  double evals = 0.0;
+  for (int f=0; f<frames; f++)
+  {
+    bench_clock::time_point t0 = bench_clock::now();
+    ball_set_move (&balls, width, height);
+    for (int b=0; b<BALL_COUNT; b++)
+    {
+      bx[b] = (float)balls.x[b];
+      by[b] = (float)balls.y[b];
+      br2[b] = (float)(balls.radius[b] * balls.radius[b]);
+    }
+    bench_clock::time_point t1 = bench_clock::now();
+    if (fused)
+    {
+      classify_field (&cells, cell_x, cell_y, (float)width, (float)height, bx, by, br2, BALL_COUNT, ISO_THRESHOLD, linear_interp);
+      evals += (double)(cell_x + 1) * (cell_y + 1);
+    }
+    else if ((!field_mode || exporting) && narrow)
+      evals += narrow_band_update (&band, &grid, bx, by, br2, BALL_COUNT, ISO_THRESHOLD);
+    else if (!field_mode || exporting)
+    {
+      field_grid_eval (&grid, bx, by, br2, BALL_COUNT);
+      evals += (double)(cell_x + 1) * (cell_y + 1);
+    }
+    bench_clock::time_point t2 = bench_clock::now();
+    if (fused)
+      classify_triangles (&cells, &tris);
+    else if (!field_mode)
+      march_grid (&grid, ISO_THRESHOLD, linear_interp, &tris);
+    bench_clock::time_point t3 = bench_clock::now();
+    frame_buffer_clear (&fb, raster_rgba (0, 0, 0, 0xff));
+    if (field_mode)
+      raster_field (&fb, bx, by, br2, BALL_COUNT, ISO_THRESHOLD, raster_rgba (0, 0xff, 0, 0xff), threads);
+    else if (!tris.empty())
+      raster_triangles (&fb, &tris[0], tris.size() / 2, raster_rgba (0, 0xff, 0, 0xff), threads);
+    bench_clock::time_point t4 = bench_clock::now();
+    if (pattern != NULL)
+    {
+      path.resize (strlen (pattern) + 32);
+      snprintf (&path[0], path.size(), pattern, f);
+      if (!(raw ? frame_write_raw (&fb, &path[0]) : frame_write_ppm (&fb, &path[0])))
+      {
+        fprintf (stderr, "Cannot write %s\n", &path[0]);
+        if (exporting)
+          contour_export_close (&exporter);
+        return 1;
+      }
+    }
+    bench_clock::time_point t5 = bench_clock::now();
+    if (exporting)
+    {
+      contour_extract (&grid, ISO_THRESHOLD, linear_interp, &outline);
+      contour_export_push (&exporter, &outline);
+    }
+    bench_clock::time_point t6 = bench_clock::now();
+
+    move_ms += elapsed_ms (t0, t1);
+    field_ms += elapsed_ms (t1, t2);
+    march_ms += elapsed_ms (t2, t3);
+    raster_ms += elapsed_ms (t3, t4);
+    write_ms += elapsed_ms (t4, t5);
+    export_ms += elapsed_ms (t5, t6);
+    total_tris += tris.size() / 6;
+  }
+
+  if (field_mode)
+    printf ("%d frames %dx%d, per pixel field, %d threads\n", frames, width, height, threads);
+  else
+    printf ("%d frames %dx%d, %dx%d cells, %zu triangles/frame, %d threads\n", frames, width, height, cell_x, cell_y, total_tris / frames, threads);
+  printf ("ms/frame: move %.4f  field %.4f  march %.4f  raster %.4f  write %.4f  export %.4f\n",
+          move_ms / frames, field_ms / frames, march_ms / frames, raster_ms / frames, write_ms / frames, export_ms / frames);
+  if (narrow)
+    printf ("narrow band: %.1f%% of the corners evaluated\n", 100.0 * evals / ((double)(cell_x + 1) * (cell_y + 1) * frames));
+  if (exporting)
+  {
+    int dropped = exporter.dropped;
+    if (!contour_export_close (&exporter))
+    {
+      fprintf (stderr, "Contour export failed\n");
+      return 1;
+    }
+    printf ("contours: %d frames exported, %d dropped\n", frames - dropped, dropped);
+  }
+  ball_set_free (&balls);
+  frame_buffer_free (&fb);
+  narrow_band_free (&band);
+  field_grid_free (&grid);
+  return 0;
+}
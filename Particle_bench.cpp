@@ -0,0 +1,343 @@
+/**Author: Un Hou (Albert) Chan
+ * Scaling benchmark of the project 2 particles, no window needed.
+ * Sweeps particle counts and thread counts and times the two per frame stages: the
+ * simulation step (double buffered, as particle_sim runs it) and packing the visible
+ * particles into vertices (points, as drawParticles does in 'p' mode). The explosion is
+ * one seeded burst of immortal particles, so none dies and every frame costs the same.
+ * With -c the particles collide after every step, timed on its own (sort and narrow phase).
+ * With -d the blended drawing is timed too: depth sort (radix) and packing in that order.
+ * It also times the analytic mode (-a in project 2): packing the burst in closed form at
+ * each frame's time, which reads the emitted state and writes nothing but vertices.
+ * Last the burst is stepped in packed storage (particle_packed: 16 bit positions, half float
+ * velocities), in place, the bandwidth it saves being the point.
+ *
+ * Usage: particle_bench [-p list] [-t list] [-n frames] [-s seed] [-f] [-c radius] [-d] [-csv file] [-json file]
+ * -p list    particle counts, default 1000,10000,100000,1000000,10000000,50000000
+ * -t list    threads, default 1 and one per hardware thread
+ * -n N       timed frames per run, default 20, after one untimed warm up frame
+ * -s N       random seed, default 1
+ * -f         step under every kind of force (gravity, both drags, 4 attractors, 4 vortices)
+ * -c R       collide particles of radius R after every step, restitution 1
+ * -d         depth sort (view along -z) and pack back to front every frame
+ * -csv file  results as CSV, - for stdout
+ * -json file results as a JSON array, - for stdout
+ * Without -csv or -json a table is printed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "particle/particle.h"
+#include "particle/collide.h"
+#include "particle/depth_sort.h"
+#include "particle/particle_packed.h"
+#include "aclib/parallel.h"
+
+//bytes a step reads and writes per particle: 8 floats each way
+#define STEP_BYTES (16.0 * sizeof(float))
+//bytes a packed step reads and writes per particle: 8 shorts read, 4 written back
+#define PACKED_STEP_BYTES (12.0 * sizeof(unsigned short))
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**int particles, threads; what was run
+ * bool skipped; out of memory, nothing timed
+ * double step_ms, pack_ms; per frame
+ * double eval_ms; per frame, closed form packing
+ * double collide_ms; per frame, 0 without -c
+ * double contacts; per frame
+ * double sort_ms; per frame, depth sort and back to front packing, 0 without -d
+ * double half_ms; per frame, step in packed storage, 0 if it could not be allocated
+*/
+typedef struct bench_result
+{
+  int particles;
+  int threads;
+  bool skipped;
+  double step_ms;
+  double pack_ms;
+  double eval_ms;
+  double collide_ms;
+  double contacts;
+  double sort_ms;
+  double half_ms;
+} bench_result;
+
+static double elapsed_ms (bench_clock::time_point t0, bench_clock::time_point t1)
+{
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+/**Comma separated positive integers
+*/
+static bool parse_ints (const char* text, std::vector<int>* out)
+{
+  out->clear();
+  while (*text != '\0')
+  {
+    char* end;
+    long v = strtol (text, &end, 10);
+    if (end == text || v < 1 || (*end != ',' && *end != '\0'))
+      return false;
+    out->push_back ((int)v);
+    text = *end == ',' ? end + 1 : end;
+  }
+  return !out->empty();
+}
+
+/**Gravity, drag, and the most attractors and vortices, spread around the origin
+*/
+static void all_forces (particle_forces* forces)
+{
+  particle_forces_init (forces);
+  forces->gy = -0.0005f;
+  forces->drag = 0.005f;
+  forces->drag2 = 0.5f;
+  forces->attractors = PARTICLE_MAX_ATTRACTORS;
+  for (int a=0; a<PARTICLE_MAX_ATTRACTORS; a++)
+  {
+    particle_attractor* A = &forces->attractor[a];
+    A->x = (float)(a - 1);
+    A->y = 1.0f;
+    A->z = 0.0f;
+    A->strength = 0.001f;
+    A->soften = 0.25f;
+  }
+  forces->vortices = PARTICLE_MAX_VORTICES;
+  for (int v=0; v<PARTICLE_MAX_VORTICES; v++)
+  {
+    particle_vortex* V = &forces->vortex[v];
+    V->x = V->z = 0.0f;
+    V->y = (float)v;
+    V->ax = V->az = 0.0f;
+    V->ay = 1.0f;
+    V->strength = 0.001f;
+    V->soften = 0.25f;
+  }
+}
+
+static void run (bench_result* r, int frames, unsigned int seed, const particle_forces* forces, float radius, bool depth)
+{
+  //eye space z of project 2, which only translates along z
+  const float axis[3] = {0.0f, 0.0f, 1.0f};
+  particle_set buf[2];
+  particle_grid grid;
+  particle_depth_order order;
+  particle_emitter emitter;
+  particle_vertex* verts = NULL;
+
+  particle_set_init (&buf[0]);
+  particle_set_init (&buf[1]);
+  particle_grid_init (&grid);
+  particle_depth_init (&order);
+  if (!particle_set_resize (&buf[0], r->particles) || !particle_set_resize (&buf[1], r->particles) ||
+      (verts = (particle_vertex*) malloc ((size_t)r->particles * sizeof(particle_vertex))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate %d particles\n", r->particles);
+    r->skipped = true;
+    particle_set_free (&buf[0]);
+    particle_set_free (&buf[1]);
+    return;
+  }
+  particle_emitter_init (&emitter, seed);
+  emitter.burst = r->particles;
+  particle_emit (&buf[0], &emitter);
+  r->step_ms = r->pack_ms = r->collide_ms = r->contacts = r->sort_ms = 0.0;
+  int front = 0;
+  //frame -1 touches every page once
+  for (int f=-1; f<frames; f++)
+  {
+    bench_clock::time_point t0 = bench_clock::now();
+    particle_set_step (&buf[front], &buf[1 - front], forces, r->threads);
+    front = 1 - front;
+    bench_clock::time_point t1 = bench_clock::now();
+    if (radius > 0.0f)
+      particle_collide (&buf[front], &grid, radius, 1.0f, r->threads);
+    bench_clock::time_point t2 = bench_clock::now();
+    particle_set_pack (&buf[front], false, 0.0f, verts, r->threads);
+    bench_clock::time_point t3 = bench_clock::now();
+    if (depth)
+    {
+      particle_depth_sort (&order, &buf[front], axis, 1, r->threads);
+      particle_depth_pack (&order, &buf[front], false, 0.0f, verts, r->threads);
+    }
+    bench_clock::time_point t4 = bench_clock::now();
+    if (f < 0)
+      continue;
+    r->sort_ms += elapsed_ms (t3, t4);
+    r->step_ms += elapsed_ms (t0, t1);
+    r->collide_ms += elapsed_ms (t1, t2);
+    r->pack_ms += elapsed_ms (t2, t3);
+    r->contacts += grid.contacts;
+  }
+  r->step_ms /= frames;
+  r->pack_ms /= frames;
+  r->collide_ms /= frames;
+  r->contacts /= frames;
+  r->sort_ms /= frames;
+  particle_grid_free (&grid);
+  particle_depth_free (&order);
+
+  //the same burst again, never stepped
+  particle_set_clear (&buf[0]);
+  particle_emitter_init (&emitter, seed);
+  emitter.burst = r->particles;
+  particle_emit (&buf[0], &emitter);
+  r->eval_ms = 0.0;
+  for (int f=-1; f<frames; f++)
+  {
+    bench_clock::time_point t0 = bench_clock::now();
+    particle_set_pack_at (&buf[0], (float)(f + 2), false, 0.0f, verts, r->threads);
+    if (f >= 0)
+      r->eval_ms += elapsed_ms (t0, bench_clock::now());
+  }
+  r->eval_ms /= frames;
+  free (verts);
+
+  //the same burst once more, packed; the box holds every frame's step
+  particle_packed packed;
+  float reach = emitter.speed * 1.0001f * (frames + 2);
+  float lo[3] = {-reach, -reach, -reach};
+  float hi[3] = {reach, reach, reach};
+  r->half_ms = 0.0;
+  particle_packed_init (&packed);
+  if (!particle_packed_resize (&packed, r->particles) || !particle_packed_encode (&packed, &buf[0], lo, hi))
+    fprintf (stderr, "Cannot allocate %d packed particles\n", r->particles);
+  else
+  {
+    for (int f=-1; f<frames; f++)
+    {
+      bench_clock::time_point t0 = bench_clock::now();
+      particle_packed_step (&packed, r->threads);
+      if (f >= 0)
+        r->half_ms += elapsed_ms (t0, bench_clock::now());
+    }
+    r->half_ms /= frames;
+  }
+  particle_packed_free (&packed);
+  particle_set_free (&buf[0]);
+  particle_set_free (&buf[1]);
+}
+
+static FILE* open_output (const char* path)
+{
+  if (path == NULL)
+    return NULL;
+  if (strcmp (path, "-") == 0)
+    return stdout;
+  return fopen (path, "w");
+}
+
+static bool close_output (FILE* file)
+{
+  if (file == NULL || file == stdout)
+    return file == NULL || fflush (file) == 0;
+  return fclose (file) == 0;
+}
+
+int main (int argc, char *argv[])
+{
+  std::vector<int> counts, thread_counts;
+  int frames = 20;
+  unsigned int seed = 1;
+  const char* csv_path = NULL;
+  const char* json_path = NULL;
+  particle_forces forces;
+  bool use_forces = false;
+  float radius = 0.0f;
+  bool depth = false;
+
+  parse_ints ("1000,10000,100000,1000000,10000000,50000000", &counts);
+  thread_counts.push_back (1);
+  if (aclib::hardware_threads() > 1)
+    thread_counts.push_back (aclib::hardware_threads());
+  for (int i=1; i<argc; i++)
+  {
+    bool ok = true;
+    if (strcmp (argv[i], "-p") == 0 && i+1 < argc)
+      ok = parse_ints (argv[++i], &counts);
+    else if (strcmp (argv[i], "-t") == 0 && i+1 < argc)
+      ok = parse_ints (argv[++i], &thread_counts);
+    else if (strcmp (argv[i], "-n") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%d", &frames) == 1 && frames > 0;
+    else if (strcmp (argv[i], "-s") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%u", &seed) == 1;
+    else if (strcmp (argv[i], "-f") == 0)
+      use_forces = true;
+    else if (strcmp (argv[i], "-d") == 0)
+      depth = true;
+    else if (strcmp (argv[i], "-c") == 0 && i+1 < argc)
+      ok = sscanf (argv[++i], "%f", &radius) == 1 && radius > 0.0f;
+    else if (strcmp (argv[i], "-csv") == 0 && i+1 < argc)
+      csv_path = argv[++i];
+    else if (strcmp (argv[i], "-json") == 0 && i+1 < argc)
+      json_path = argv[++i];
+    else
+      ok = false;
+    if (!ok)
+    {
+      fprintf (stderr, "Usage: %s [-p list] [-t list] [-n frames] [-s seed] [-f] [-c radius] [-d] [-csv file] [-json file]\n", argv[0]);
+      return 1;
+    }
+  }
+  all_forces (&forces);
+  FILE* csv = open_output (csv_path);
+  FILE* json = open_output (json_path);
+  if ((csv_path != NULL && csv == NULL) || (json_path != NULL && json == NULL))
+  {
+    fprintf (stderr, "Cannot create %s\n", csv_path != NULL && csv == NULL ? csv_path : json_path);
+    return 1;
+  }
+  bool table = csv == NULL && json == NULL;
+
+  if (table)
+    printf ("%10s %7s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "particles", "threads", "step ms", "ns/part",
+            "step GB/s", "pack ms", "eval ms", "collide ms", "contacts", "sort ms", "half ms", "half GB/s");
+  if (csv != NULL)
+    fprintf (csv, "particles,threads,frames,seed,skipped,step_ms,pack_ms,eval_ms,collide_ms,contacts,sort_ms,step_gbps,half_ms,half_gbps\n");
+  if (json != NULL)
+    fprintf (json, "[\n");
+  bool first = true;
+  for (size_t p=0; p<counts.size(); p++)
+    for (size_t t=0; t<thread_counts.size(); t++)
+    {
+      bench_result r;
+      memset (&r, 0, sizeof(r));
+      r.particles = counts[p];
+      r.threads = thread_counts[t];
+      run (&r, frames, seed, use_forces ? &forces : NULL, radius, depth);
+      double gbps = r.skipped || r.step_ms <= 0.0 ? 0.0 : STEP_BYTES * r.particles / (r.step_ms * 1e6);
+      double half_gbps = r.skipped || r.half_ms <= 0.0 ? 0.0 : PACKED_STEP_BYTES * r.particles / (r.half_ms * 1e6);
+
+      if (table && r.skipped)
+        printf ("%10d %7d %10s\n", r.particles, r.threads, "skipped");
+      else if (table)
+        printf ("%10d %7d %10.4f %10.3f %10.2f %10.4f %10.4f %10.4f %10.0f %10.4f %10.4f %10.2f\n", r.particles, r.threads,
+                r.step_ms, r.step_ms * 1e6 / r.particles, gbps, r.pack_ms, r.eval_ms, r.collide_ms, r.contacts, r.sort_ms,
+                r.half_ms, half_gbps);
+      if (csv != NULL)
+        fprintf (csv, "%d,%d,%d,%u,%d,%.6f,%.6f,%.6f,%.6f,%.1f,%.6f,%.3f,%.6f,%.3f\n", r.particles, r.threads, frames, seed,
+                 r.skipped ? 1 : 0, r.step_ms, r.pack_ms, r.eval_ms, r.collide_ms, r.contacts, r.sort_ms, gbps,
+                 r.half_ms, half_gbps);
+      if (json != NULL)
+        fprintf (json, "%s  {\"particles\": %d, \"threads\": %d, \"frames\": %d, \"seed\": %u, \"skipped\": %s, "
+                 "\"step_ms\": %.6f, \"pack_ms\": %.6f, \"eval_ms\": %.6f, \"collide_ms\": %.6f, "
+                 "\"contacts\": %.1f, \"sort_ms\": %.6f, \"step_gbps\": %.3f, \"half_ms\": %.6f, \"half_gbps\": %.3f}",
+                 first ? "" : ",\n", r.particles, r.threads, frames, seed, r.skipped ? "true" : "false",
+                 r.step_ms, r.pack_ms, r.eval_ms, r.collide_ms, r.contacts, r.sort_ms, gbps, r.half_ms, half_gbps);
+      first = false;
+      if (table)
+        fflush (stdout);
+    }
+  if (json != NULL)
+    fprintf (json, "\n]\n");
+  if (!close_output (csv) || !close_output (json))
+  {
+    fprintf (stderr, "Cannot write the results\n");
+    return 1;
+  }
+  return 0;
+}
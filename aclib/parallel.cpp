@@ -0,0 +1,143 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#if defined(__APPLE__)
+  #include <sys/sysctl.h>
+#elif defined(__linux__)
+  #include <unistd.h>
+#endif
+
+namespace{
+
+    /**One parallel_for call, on its caller's stack: claimed counts the workers that joined
+     * it, wanted how many may, active how many still run it. All but next are guarded by the
+     * pool lock
+    */
+    struct pool_job{
+        const std::function<void(int)>* func;
+        int count;
+        std::atomic<int> next;
+        int wanted;
+        int claimed;
+        int active;
+    };
+
+    /**Threads kept for the life of the process, and the jobs open to them, oldest first
+    */
+    struct thread_pool{
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::vector<std::thread> workers;
+        std::vector<pool_job*> jobs;
+        bool stop;
+
+        thread_pool(): stop(false){}
+        ~thread_pool(){
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop = true;
+                wake.notify_all();
+            }
+            for (size_t t=0; t<workers.size(); t++)
+                workers[t].join();
+        }
+    };
+
+    thread_pool pool;
+
+    void run_tasks(pool_job* job){
+        for (int task = job->next++; task < job->count; task = job->next++)
+            (*job->func)(task);
+    }
+
+    /**Oldest job that wants more workers, NULL for none. Call with the pool lock held
+    */
+    pool_job* open_job(){
+        for (size_t j=0; j<pool.jobs.size(); j++)
+            if (pool.jobs[j]->claimed < pool.jobs[j]->wanted)
+                return pool.jobs[j];
+        return NULL;
+    }
+
+    void pool_worker(){
+        std::unique_lock<std::mutex> guard(pool.lock);
+        for (;;){
+            pool_job* job = NULL;
+            while (!pool.stop && (job = open_job()) == NULL)
+                pool.wake.wait(guard);
+            if (pool.stop)
+                break;
+            job->claimed++;
+            job->active++;
+            guard.unlock();
+            run_tasks(job);
+            guard.lock();
+            if (--job->active == 0)
+                pool.done.notify_all();
+        }
+    }
+}
+
+int aclib::hardware_threads(){
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
+
+int aclib::l2_cache_bytes(){
+    long bytes = 0;
+#if defined(__APPLE__)
+    size_t size = sizeof(bytes);
+    if (sysctlbyname("hw.l2cachesize", &bytes, &size, NULL, 0) != 0)
+        bytes = 0;
+#elif defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+    bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return bytes > 0 ? (int)bytes : 256 * 1024;
+}
+
+void aclib::parallel_for(int count, int threads, const std::function<void(int)>& func){
+    if (threads <= 0)
+        threads = hardware_threads();
+    if (threads > count)
+        threads = count;
+    if (threads <= 1){
+        for (int task=0; task<count; task++)
+            func(task);
+        return;
+    }
+
+    //the caller works on its own job whatever else runs, so nested and concurrent calls
+    //share the workers and never wait on each other
+    pool_job job;
+    job.func = &func;
+    job.count = count;
+    job.next = 0;
+    job.wanted = threads - 1;
+    job.claimed = 0;
+    job.active = 0;
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        while ((int)pool.workers.size() < threads - 1)
+            pool.workers.push_back(std::thread(pool_worker));
+        pool.jobs.push_back(&job);
+        pool.wake.notify_all();
+    }
+    run_tasks(&job);
+    {
+        //workers that have not joined yet stay out, then wait for the ones that did
+        std::unique_lock<std::mutex> guard(pool.lock);
+        job.wanted = job.claimed;
+        for (size_t j=0; j<pool.jobs.size(); j++)
+            if (pool.jobs[j] == &job){
+                pool.jobs.erase(pool.jobs.begin() + j);
+                break;
+            }
+        while (job.active > 0)
+            pool.done.wait(guard);
+    }
+}
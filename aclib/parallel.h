@@ -0,0 +1,27 @@
+/**Author: Un Hou (Albert) Chan
+ * Minimal fork-join helper on top of a persistent std::thread pool
+ * Dependancy: none
+*/
+#pragma once
+
+#include <functional>
+
+namespace aclib{
+
+    /**Number of hardware threads, at least 1
+    */
+    int hardware_threads();
+
+    /**Size of one L2 cache in bytes, for sizing per-thread chunks. 256KB when unknown
+    */
+    int l2_cache_bytes();
+
+    /**Run func(task) for task in [0, count) on up to threads threads and wait for all of them.
+     * Tasks are handed out in order from a shared counter, so uneven tasks balance out.
+     * threads <= 0 means hardware_threads(). The calling thread works too, the others come
+     * from a pool kept for the life of the process, so a call does not start threads.
+     * Calls may come from several threads at once, and may nest in a task: every call is
+     * queued as its own job, and free workers join the oldest job still wanting them.
+    */
+    void parallel_for( int count, int threads, const std::function<void(int)>& func );
+}
@@ -0,0 +1,260 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "ball.h"
+*/
+
+#include "ball.h"
+
+#include <stdlib.h>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+//wall mask bits, a wall is touched when the ball edge is on or past it
+#define WALL_LEFT 1
+#define WALL_RIGHT 2
+#define WALL_TOP 4
+#define WALL_BOTTOM 8
+
+//walls each direction is heading for; touching any other wall does not bounce
+static const int heading_walls[8] =
+{
+  WALL_TOP, WALL_TOP | WALL_RIGHT, WALL_RIGHT, WALL_BOTTOM | WALL_RIGHT,
+  WALL_BOTTOM, WALL_BOTTOM | WALL_LEFT, WALL_LEFT, WALL_TOP | WALL_LEFT
+};
+//step of each direction
+static const int step_x[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int step_y[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+
+/**Move table, index ((direction * 16 + wall mask) * 2 + random bit).
+ * Entry: new direction in bits 0-7, step x + 1 in bits 8-15, step y + 1 in bits 16-23
+*/
+static int ball_moves[8 * 16 * 2];
+static bool ball_moves_built = false;
+
+/**Bounce rules: where a ball heading dir goes when it touches the walls in mask.
+ * Corners send it straight back, otherwise it picks one of two directions away from the wall.
+ * @param pick receives the two candidates, the random bit chooses between them
+*/
+static void bounce_direction (int dir, int mask, int* pick)
+{
+  bool left = (mask & WALL_LEFT) != 0;
+  bool right = (mask & WALL_RIGHT) != 0;
+  bool top = (mask & WALL_TOP) != 0;
+  bool bottom = (mask & WALL_BOTTOM) != 0;
+  int a = dir, b = dir;
+
+  switch (dir)
+  {
+    case NORTH:
+      if (left && top)
+        a = b = SOUTHEAST;
+      else if (right && top)
+        a = b = SOUTHWEST;
+      else
+        a = SOUTHEAST, b = SOUTHWEST;
+    break;
+    case NORTHEAST:
+      if (right)
+      {
+        if (top)
+          a = b = SOUTHWEST;
+        else
+          a = NORTHWEST, b = WEST;
+      }
+      else
+        a = SOUTHEAST, b = EAST;
+    break;
+    case EAST:
+      if (top)
+        a = b = SOUTHWEST;
+      else if (bottom)
+        a = b = NORTHWEST;
+      else
+        a = NORTHWEST, b = SOUTHWEST;
+    break;
+    case SOUTHEAST:
+      if (bottom)
+      {
+        if (right)
+          a = b = NORTHWEST;
+        else
+          a = NORTH, b = NORTHEAST;
+      }
+      else
+        a = SOUTH, b = SOUTHWEST;
+    break;
+    case SOUTH:
+      a = b = right ? NORTHWEST : NORTHEAST;
+    break;
+    case SOUTHWEST:
+      if (left)
+        a = b = bottom ? NORTHEAST : SOUTHEAST;
+      else
+        a = NORTH, b = NORTHWEST;
+    break;
+    case WEST:
+      if (top)
+        a = b = SOUTHEAST;
+      else if (bottom)
+        a = b = NORTHEAST;
+      else
+        a = NORTHEAST, b = SOUTHEAST;
+    break;
+    case NORTHWEST:
+      if (left)
+      {
+        if (top)
+          a = b = SOUTHEAST;
+        else
+          a = NORTHEAST, b = EAST;
+      }
+      else if (top)
+        a = SOUTHWEST, b = SOUTH;
+    break;
+    default:
+    break;
+  }
+  pick[0] = a;
+  pick[1] = b;
+}
+
+static void build_ball_moves ()
+{
+  for (int dir=0; dir<8; dir++)
+    for (int mask=0; mask<16; mask++)
+    {
+      int pick[2] = {dir, dir};
+      if (mask & heading_walls[dir])
+        bounce_direction (dir, mask, pick);
+      for (int bit=0; bit<2; bit++)
+      {
+        int d = pick[bit];
+        ball_moves[(dir * 16 + mask) * 2 + bit] = d | ((step_x[d] + 1) << 8) | ((step_y[d] + 1) << 16);
+      }
+    }
+  ball_moves_built = true;
+}
+
+void ball_set_init (ball_set* set)
+{
+  set->count = 0;
+  set->x = NULL;
+  set->y = NULL;
+  set->radius = NULL;
+  set->direction = NULL;
+  set->rng = NULL;
+}
+
+bool ball_set_resize (ball_set* set, int count)
+{
+  ball_set_free (set);
+  if (count < 1)
+    return count == 0;
+
+  set->x = (int*) calloc ((size_t)count, sizeof(int));
+  set->y = (int*) calloc ((size_t)count, sizeof(int));
+  set->radius = (int*) calloc ((size_t)count, sizeof(int));
+  set->direction = (int*) calloc ((size_t)count, sizeof(int));
+  set->rng = (unsigned int*) calloc ((size_t)count, sizeof(unsigned int));
+  if (set->x == NULL || set->y == NULL || set->radius == NULL || set->direction == NULL || set->rng == NULL)
+  {
+    ball_set_free (set);
+    return false;
+  }
+  set->count = count;
+  ball_set_seed (set, 1);
+  return true;
+}
+
+void ball_set_free (ball_set* set)
+{
+  free (set->x);
+  free (set->y);
+  free (set->radius);
+  free (set->direction);
+  free (set->rng);
+  ball_set_init (set);
+}
+
+void ball_set_seed (ball_set* set, unsigned int seed)
+{
+  //splitmix step per ball so neighbouring balls get unrelated streams
+  unsigned long long s = seed;
+  for (int k=0; k<set->count; k++)
+  {
+    s += 0x9E3779B97F4A7C15ULL;
+    unsigned long long z = s;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    unsigned int r = (unsigned int)(z ^ (z >> 31));
+    set->rng[k] = r != 0 ? r : 0x6D2B79F5u;
+  }
+}
+
+/**One ball: wall mask, random bit, one table load
+*/
+static inline void move_one (ball_set* set, int k, int right_edge, int bottom_edge)
+{
+  int x = set->x[k];
+  int y = set->y[k];
+  int r = set->radius[k];
+  int mask = (x - r < 1) | ((x + r > right_edge) << 1) | ((y - r < 1) << 2) | ((y + r > bottom_edge) << 3);
+  unsigned int s = set->rng[k];
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  set->rng[k] = s;
+  int move = ball_moves[(((set->direction[k] << 4) | mask) << 1) | (int)(s >> 31)];
+  set->direction[k] = move & 0xFF;
+  set->x[k] = x + ((move >> 8) & 0xFF) - 1;
+  set->y[k] = y + ((move >> 16) & 0xFF) - 1;
+}
+
+void ball_set_move (ball_set* set, int world_w, int world_h)
+{
+  if (!ball_moves_built)
+    build_ball_moves();
+
+  //x + r >= w is x + r > w - 1
+  int right_edge = world_w - 1;
+  int bottom_edge = world_h - 1;
+  int k = 0;
+#ifdef __SSE2__
+  const __m128i one = _mm_set1_epi32 (1);
+  const __m128i right_v = _mm_set1_epi32 (right_edge);
+  const __m128i bottom_v = _mm_set1_epi32 (bottom_edge);
+  const __m128i byte = _mm_set1_epi32 (0xFF);
+  for (; k + 4 <= set->count; k += 4)
+  {
+    __m128i x = _mm_loadu_si128 ((const __m128i*)(set->x + k));
+    __m128i y = _mm_loadu_si128 ((const __m128i*)(set->y + k));
+    __m128i r = _mm_loadu_si128 ((const __m128i*)(set->radius + k));
+    __m128i d = _mm_loadu_si128 ((const __m128i*)(set->direction + k));
+    __m128i s = _mm_loadu_si128 ((const __m128i*)(set->rng + k));
+
+    //compares give all ones per touched wall, keep the wall bit
+    __m128i mask = _mm_and_si128 (_mm_cmplt_epi32 (_mm_sub_epi32 (x, r), one), _mm_set1_epi32 (WALL_LEFT));
+    mask = _mm_or_si128 (mask, _mm_and_si128 (_mm_cmpgt_epi32 (_mm_add_epi32 (x, r), right_v), _mm_set1_epi32 (WALL_RIGHT)));
+    mask = _mm_or_si128 (mask, _mm_and_si128 (_mm_cmplt_epi32 (_mm_sub_epi32 (y, r), one), _mm_set1_epi32 (WALL_TOP)));
+    mask = _mm_or_si128 (mask, _mm_and_si128 (_mm_cmpgt_epi32 (_mm_add_epi32 (y, r), bottom_v), _mm_set1_epi32 (WALL_BOTTOM)));
+
+    s = _mm_xor_si128 (s, _mm_slli_epi32 (s, 13));
+    s = _mm_xor_si128 (s, _mm_srli_epi32 (s, 17));
+    s = _mm_xor_si128 (s, _mm_slli_epi32 (s, 5));
+    _mm_storeu_si128 ((__m128i*)(set->rng + k), s);
+
+    __m128i index = _mm_or_si128 (_mm_slli_epi32 (_mm_or_si128 (_mm_slli_epi32 (d, 4), mask), 1), _mm_srli_epi32 (s, 31));
+    int lane[4];
+    _mm_storeu_si128 ((__m128i*)lane, index);
+    __m128i move = _mm_setr_epi32 (ball_moves[lane[0]], ball_moves[lane[1]], ball_moves[lane[2]], ball_moves[lane[3]]);
+
+    _mm_storeu_si128 ((__m128i*)(set->direction + k), _mm_and_si128 (move, byte));
+    x = _mm_sub_epi32 (_mm_add_epi32 (x, _mm_and_si128 (_mm_srli_epi32 (move, 8), byte)), one);
+    y = _mm_sub_epi32 (_mm_add_epi32 (y, _mm_and_si128 (_mm_srli_epi32 (move, 16), byte)), one);
+    _mm_storeu_si128 ((__m128i*)(set->x + k), x);
+    _mm_storeu_si128 ((__m128i*)(set->y + k), y);
+  }
+#endif
+  for (; k<set->count; k++)
+    move_one (set, k, right_edge, bottom_edge);
+}
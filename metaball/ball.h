@@ -0,0 +1,53 @@
+/**Author: Un Hou (Albert) Chan
+ * Metaball balls and the bouncing movement shared by the 2D and 3D metaballs.
+ *
+ * Balls are kept as a structure of arrays and moved as a batch. A ball moves one unit
+ * per step along one of 8 directions. When it touches a wall it is heading for, it
+ * bounces: the new direction depends only on the old direction, which walls are
+ * touched (4 bit mask) and one random bit, so it comes from a lookup table built once.
+ * Wall tests are packed compares (SSE2 when available) and every ball carries its own
+ * xorshift state, so the whole step is branch free.
+*/
+#pragma once
+
+#define UNDEFINED -1
+#define NORTH 0
+#define NORTHEAST 1
+#define EAST 2
+#define SOUTHEAST 3
+#define SOUTH 4
+#define SOUTHWEST 5
+#define WEST 6
+#define NORTHWEST 7
+
+/**int count; number of balls
+ * int* x, *y; centers, world unit
+ * int* radius;
+ * int* direction; see #define
+ * unsigned int* rng; xorshift state of every ball, never 0
+*/
+typedef struct ball_set
+{
+  int count;
+  int* x;
+  int* y;
+  int* radius;
+  int* direction;
+  unsigned int* rng;
+} ball_set;
+
+/**Initialize an empty set. Must be called before ball_set_resize
+*/
+void ball_set_init (ball_set* set);
+/**Make room for count balls. Contents are not kept
+ * @return false if out of memory, the set is then empty
+*/
+bool ball_set_resize (ball_set* set, int count);
+void ball_set_free (ball_set* set);
+/**Seed the random state of every ball. Same seed, same bounces
+*/
+void ball_set_seed (ball_set* set, unsigned int seed);
+/**Move every ball one step, bouncing off the walls of the world first
+ * @param world_w, world_h size of the world the balls bounce in
+*/
+void ball_set_move (ball_set* set, int world_w, int world_h);
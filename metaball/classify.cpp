@@ -0,0 +1,133 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "classify.h", "field.h", "march.h"
+*/
+
+#include "classify.h"
+#include "march.h"
+
+/**Corner row j: balls outside, stride-1 corner loop inside, same order as field_grid_eval
+*/
+static void eval_row (float* row, const float* xs, int cols, float y,
+                      const float* bx, const float* by, const float* br2, int n)
+{
+  for (int i=0; i<cols; i++)
+    row[i] = 0.0f;
+  for (int b=0; b<n; b++)
+  {
+    float cx = bx[b];
+    float r2 = br2[b];
+    float dy = y - by[b];
+    float dy2 = dy * dy;
+    for (int i=0; i<cols; i++)
+    {
+      float dx = xs[i] - cx;
+      row[i] += r2 / (dx * dx + dy2);
+    }
+  }
+}
+
+void classify_field (cell_list* list, int cell_x, int cell_y, float width, float height,
+                     const float* bx, const float* by, const float* br2, int n, float iso, bool linear_interp)
+{
+  int cols = cell_x + 1;
+
+  list->cell_x = cell_x;
+  list->cell_y = cell_y;
+  list->cell_w = width / (float)cell_x;
+  list->cell_h = height / (float)cell_y;
+  list->cell.clear();
+  list->cases.clear();
+  list->frac.clear();
+  list->runs.clear();
+  //corner X first, then the two corner rows
+  list->rows.resize ((size_t)cols * 3);
+  list->above.resize ((size_t)cols * 2);
+  float* xs = &list->rows[0];
+  for (int i=0; i<cols; i++)
+    xs[i] = (float)i * list->cell_w;
+
+  float* r0 = xs + cols;
+  float* r1 = r0 + cols;
+  unsigned char* a0 = &list->above[0];
+  unsigned char* a1 = a0 + cols;
+  eval_row (r0, xs, cols, 0.0f, bx, by, br2, n);
+  for (int i=0; i<cols; i++)
+    a0[i] = r0[i] >= iso ? 1 : 0;
+  for (int j=0; j<cell_y; j++)
+  {
+    eval_row (r1, xs, cols, (float)(j+1) * list->cell_h, bx, by, br2, n);
+    for (int i=0; i<cols; i++)
+      a1[i] = r1[i] >= iso ? 1 : 0;
+
+    int run = -1;
+    for (int i=0; i<cell_x; i++)
+    {
+      unsigned char sqr = a0[i] | a0[i+1] << 1 | a1[i] << 2 | a1[i+1] << 3;
+      if (sqr == 0xF)
+      {
+        if (run < 0)
+          run = i;
+        continue;
+      }
+      if (run >= 0)
+      {
+        list->runs.push_back (j);
+        list->runs.push_back (run);
+        list->runs.push_back (i - 1);
+        run = -1;
+      }
+      if (sqr == 0)
+        continue;
+      list->cell.push_back (j * cell_x + i);
+      list->cases.push_back (sqr);
+      float p00 = r0[i], p10 = r0[i+1], p01 = r1[i], p11 = r1[i+1];
+      if (linear_interp)
+      {
+        list->frac.push_back ((iso - p00) / (p10 - p00));
+        list->frac.push_back ((iso - p00) / (p01 - p00));
+        list->frac.push_back ((iso - p01) / (p11 - p01));
+        list->frac.push_back ((iso - p10) / (p11 - p10));
+      }
+      else
+        list->frac.insert (list->frac.end(), 4, 0.5f);
+    }
+    if (run >= 0)
+    {
+      list->runs.push_back (j);
+      list->runs.push_back (run);
+      list->runs.push_back (cell_x - 1);
+    }
+    //the lower row becomes the upper one
+    float* rt = r0; r0 = r1; r1 = rt;
+    unsigned char* at = a0; a0 = a1; a1 = at;
+  }
+}
+
+void classify_triangles (const cell_list* list, std::vector<float>* tris)
+{
+  float cell[MARCH_MAX_VERTS * 2];
+  float cw = list->cell_w;
+  float ch = list->cell_h;
+
+  tris->clear();
+  for (size_t r=0; r<list->runs.size(); r+=3)
+  {
+    float y0 = (float)list->runs[r] * ch;
+    float y1 = (float)(list->runs[r] + 1) * ch;
+    float x0 = (float)list->runs[r+1] * cw;
+    float x1 = (float)(list->runs[r+2] + 1) * cw;
+    int n = march_polygon (0xF, x0, y0, x1, y1, 0.0f, 0.0f, 0.0f, 0.0f, cell);
+    tris->insert (tris->end(), cell, cell + n*2);
+  }
+  for (size_t c=0; c<list->cell.size(); c++)
+  {
+    int i = list->cell[c] % list->cell_x;
+    int j = list->cell[c] / list->cell_x;
+    float x0 = (float)i * cw;
+    float y0 = (float)j * ch;
+    const float* f = &list->frac[c * 4];
+    int n = march_polygon (list->cases[c], x0, y0, (float)(i+1) * cw, (float)(j+1) * ch,
+                           x0 + f[0] * cw, y0 + f[1] * ch, x0 + f[2] * cw, y0 + f[3] * ch, cell);
+    tris->insert (tris->end(), cell, cell + n*2);
+  }
+}
@@ -0,0 +1,59 @@
+/**Author: Un Hou (Albert) Chan
+ * Fused field evaluation and cell classification: the field is evaluated one corner row
+ * at a time and each row of cells is classified as soon as its lower corner row is done,
+ * so only two rows of floats are ever live instead of the whole field_grid.
+ * Dependancy: "field.h", "march.h"
+ *
+ * The result is a compact list of the cells that draw anything. Cells the contour crosses
+ * keep their case and the crossing of each edge as a fraction along the edge (top and
+ * bottom from the left corner, left and right from the top corner, 0.5 without Linear
+ * Interpolation). Cells entirely inside are kept as runs along their row, one quad per run.
+ * Empty cells cost nothing after classification.
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+/**int cell_x, cell_y; grid shape
+ * float cell_w, cell_h; cell size in world unit
+ * std::vector<int> cell; j*cell_x+i of every crossed cell
+ * std::vector<unsigned char> cases; case of every crossed cell, corner bits as march.h
+ * std::vector<float> frac; 4 edge crossings of every crossed cell: top, left, bottom, right
+ * std::vector<int> runs; inside cells as (j, first i, last i) triples
+ * std::vector<float> rows; the two live corner rows
+ * std::vector<unsigned char> above; corner at or over iso, for both live rows
+*/
+typedef struct cell_list
+{
+  int cell_x;
+  int cell_y;
+  float cell_w;
+  float cell_h;
+  std::vector<int> cell;
+  std::vector<unsigned char> cases;
+  std::vector<float> frac;
+  std::vector<int> runs;
+  std::vector<float> rows;
+  std::vector<unsigned char> above;
+} cell_list;
+
+/**Evaluate the field of the balls and classify every cell of a cell_x x cell_y grid over
+ * [0,width]x[0,height]. Corner values are bit-identical to field_grid_eval.
+ * The list vectors keep their capacity between frames.
+ * @param bx, by ball centers
+ * @param br2 ball radius squared
+ * @param n number of balls
+*/
+void classify_field (cell_list* list, int cell_x, int cell_y, float width, float height,
+                     const float* bx, const float* by, const float* br2, int n, float iso, bool linear_interp);
+/**Triangles of the classified cells (x,y pairs, GL_TRIANGLES order), two per inside run.
+ * tris is cleared first; its capacity is kept between frames.
+*/
+void classify_triangles (const cell_list* list, std::vector<float>* tris);
+/**Number of crossed cells
+*/
+inline int classify_crossed (const cell_list* list)
+{
+  return (int)list->cell.size();
+}
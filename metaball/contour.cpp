@@ -0,0 +1,263 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "contour.h", "march.h", "field.h"
+*/
+
+#include "contour.h"
+#include "march.h"
+
+#include <math.h>
+
+#define EDGE_EMPTY ((size_t)-1)
+
+/**Open addressing hash from edge index to vertex index, linear probing.
+ * Edge index: 2*(j*stride+i) for the horizontal edge right of corner (i,j), +1 for the vertical edge below it
+*/
+typedef struct edge_hash
+{
+  std::vector<size_t> keys;
+  std::vector<unsigned int> vals;
+  size_t mask;
+  size_t used;
+} edge_hash;
+
+/**Everything the extraction pass shares
+*/
+typedef struct contour_ctx
+{
+  const field_grid* grid;
+  float iso;
+  bool linear_interp;
+  edge_hash hash;
+  contour_set* out;
+  std::vector<int> next;             //next vertex along the contour, -1 at an open end
+  std::vector<unsigned char> has_prev;
+} contour_ctx;
+
+static inline size_t hash_slot (const edge_hash* h, size_t key)
+{
+  size_t k = key * (size_t)0x9E3779B97F4A7C15ULL;
+  return (k ^ (k >> 29)) & h->mask;
+}
+
+static void hash_reset (edge_hash* h, size_t expect)
+{
+  size_t cap = 1024;
+  while (cap < expect * 2)
+    cap *= 2;
+  h->keys.assign (cap, EDGE_EMPTY);
+  h->vals.resize (cap);
+  h->mask = cap - 1;
+  h->used = 0;
+}
+
+static void hash_grow (edge_hash* h)
+{
+  std::vector<size_t> keys;
+  std::vector<unsigned int> vals;
+  keys.swap (h->keys);
+  vals.swap (h->vals);
+  hash_reset (h, keys.size());
+  for (size_t s=0; s<keys.size(); s++)
+  {
+    if (keys[s] == EDGE_EMPTY)
+      continue;
+    size_t slot = hash_slot (h, keys[s]);
+    while (h->keys[slot] != EDGE_EMPTY)
+      slot = (slot + 1) & h->mask;
+    h->keys[slot] = keys[s];
+    h->vals[slot] = vals[s];
+    h->used++;
+  }
+}
+
+/**Vertex of the crossing on edge key, created the first time a cell asks for it
+*/
+static unsigned int edge_vertex (contour_ctx* c, size_t key)
+{
+  edge_hash* h = &c->hash;
+  size_t slot = hash_slot (h, key);
+  while (h->keys[slot] != EDGE_EMPTY)
+  {
+    if (h->keys[slot] == key)
+      return h->vals[slot];
+    slot = (slot + 1) & h->mask;
+  }
+
+  const field_grid* grid = c->grid;
+  size_t corner = key >> 1;
+  int i = (int)(corner % grid->stride);
+  int j = (int)(corner / grid->stride);
+  float a = grid->data[corner];
+  float x = (float)i * grid->cell_w;
+  float y = (float)j * grid->cell_h;
+  if ((key & 1) == 0)
+  {
+    float b = grid->data[corner + 1];
+    x += grid->cell_w * (c->linear_interp ? (c->iso - a) / (b - a) : 0.5f);
+  }
+  else
+  {
+    float b = grid->data[corner + grid->stride];
+    y += grid->cell_h * (c->linear_interp ? (c->iso - a) / (b - a) : 0.5f);
+  }
+
+  unsigned int v = (unsigned int)(c->out->verts.size() / 2);
+  c->out->verts.push_back (x);
+  c->out->verts.push_back (y);
+  c->next.push_back (-1);
+  c->has_prev.push_back (0);
+  h->keys[slot] = key;
+  h->vals[slot] = v;
+  h->used++;
+  if (h->used * 2 > h->keys.size())
+    hash_grow (h);
+  return v;
+}
+
+void contour_extract (const field_grid* grid, float iso, bool linear_interp, contour_set* out)
+{
+  contour_ctx c;
+  c.grid = grid;
+  c.iso = iso;
+  c.linear_interp = linear_interp;
+  c.out = out;
+  //last frame's vertex count is a good guess for this one
+  hash_reset (&c.hash, out->verts.size() / 2);
+  c.next.reserve (out->verts.size() / 2);
+  c.has_prev.reserve (out->verts.size() / 2);
+  out->verts.clear();
+  out->index.clear();
+  out->line_start.clear();
+  out->closed.clear();
+
+  size_t stride = (size_t)grid->stride;
+  for (int j=0; j<grid->cell_y; j++)
+    for (int i=0; i<grid->cell_x; i++)
+    {
+      unsigned char sqr = march_case (grid, i, j, iso);
+      if (sqr == 0 || sqr == 0xF)
+        continue;
+      size_t corner = (size_t)j * stride + i;
+      //top, left, bottom, right edge index of the cell
+      size_t edge[4] = {corner * 2, corner * 2 + 1, (corner + stride) * 2, (corner + 1) * 2 + 1};
+      int seg[4];
+      int n = march_segments (sqr, seg);
+      for (int k=0; k<n; k++)
+      {
+        unsigned int va = edge_vertex (&c, edge[seg[k*2+0]]);
+        unsigned int vb = edge_vertex (&c, edge[seg[k*2+1]]);
+        c.next[va] = (int)vb;
+        c.has_prev[vb] = 1;
+      }
+    }
+
+  //chain: open lines start where nothing leads in, whatever is left is a loop
+  size_t nv = out->verts.size() / 2;
+  std::vector<unsigned char> visited (nv, 0);
+  for (size_t v=0; v<nv; v++)
+  {
+    if (c.has_prev[v] || visited[v])
+      continue;
+    out->line_start.push_back ((unsigned int)out->index.size());
+    out->closed.push_back (0);
+    for (int w=(int)v; w >= 0 && !visited[w]; w = c.next[w])
+    {
+      visited[w] = 1;
+      out->index.push_back ((unsigned int)w);
+    }
+  }
+  for (size_t v=0; v<nv; v++)
+  {
+    if (visited[v])
+      continue;
+    out->line_start.push_back ((unsigned int)out->index.size());
+    out->closed.push_back (1);
+    for (int w=(int)v; w >= 0 && !visited[w]; w = c.next[w])
+    {
+      visited[w] = 1;
+      out->index.push_back ((unsigned int)w);
+    }
+    out->index.push_back ((unsigned int)v);
+  }
+  out->line_start.push_back ((unsigned int)out->index.size());
+}
+
+/**Distance from p to segment a-b
+*/
+static float seg_dist (const float* p, const float* a, const float* b)
+{
+  float dx = b[0] - a[0];
+  float dy = b[1] - a[1];
+  float len2 = dx * dx + dy * dy;
+  float t = len2 > 0.0f ? ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / len2 : 0.0f;
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  float ex = a[0] + t * dx - p[0];
+  float ey = a[1] + t * dy - p[1];
+  return sqrtf (ex * ex + ey * ey);
+}
+
+void contour_simplify (const contour_set* in, float epsilon, contour_set* out)
+{
+  std::vector<unsigned char> keep;
+  std::vector<int> stack;
+
+  out->verts.clear();
+  out->index.clear();
+  out->line_start.clear();
+  out->closed.clear();
+  for (int l=0; l<contour_lines (in); l++)
+  {
+    const unsigned int* line = &in->index[in->line_start[l]];
+    int n = (int)(in->line_start[l+1] - in->line_start[l]);
+    keep.assign (n, 0);
+    keep[0] = 1;
+    keep[n-1] = 1;
+    //explicit stack of [first, last] ranges instead of recursion
+    stack.clear();
+    stack.push_back (0);
+    stack.push_back (n-1);
+    while (!stack.empty())
+    {
+      int last = stack.back(); stack.pop_back();
+      int first = stack.back(); stack.pop_back();
+      const float* a = &in->verts[line[first] * 2];
+      const float* b = &in->verts[line[last] * 2];
+      float worst = epsilon;
+      int split = -1;
+      for (int k=first+1; k<last; k++)
+      {
+        float d = seg_dist (&in->verts[line[k] * 2], a, b);
+        if (d > worst)
+        {
+          worst = d;
+          split = k;
+        }
+      }
+      if (split < 0)
+        continue;
+      keep[split] = 1;
+      stack.push_back (first);
+      stack.push_back (split);
+      stack.push_back (split);
+      stack.push_back (last);
+    }
+
+    out->line_start.push_back ((unsigned int)out->index.size());
+    out->closed.push_back (in->closed[l]);
+    unsigned int first_v = (unsigned int)(out->verts.size() / 2);
+    for (int k=0; k<n; k++)
+    {
+      if (!keep[k])
+        continue;
+      if (in->closed[l] && k == n-1)
+      {
+        out->index.push_back (first_v); //loop end is the loop start
+        break;
+      }
+      out->index.push_back ((unsigned int)(out->verts.size() / 2));
+      out->verts.push_back (in->verts[line[k] * 2 + 0]);
+      out->verts.push_back (in->verts[line[k] * 2 + 1]);
+    }
+  }
+  out->line_start.push_back ((unsigned int)out->index.size());
+}
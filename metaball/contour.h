@@ -0,0 +1,41 @@
+/**Author: Un Hou (Albert) Chan
+ * Metaball outlines as indexed polylines.
+ * Dependancy: "field.h", "march.h"
+ *
+ * Every crossed grid edge becomes one vertex, found through a hash keyed by the edge
+ * index, so the two cells sharing an edge share the vertex. Cell segments are then
+ * chained into polylines: loops are closed, lines that run into the grid border are open.
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+/**std::vector<float> verts; unique edge crossings, x,y pairs
+ * std::vector<unsigned int> index; vertex indices of every polyline back to back. A closed
+ *   loop repeats its first index at the end, so each line draws as one GL_LINE_STRIP
+ * std::vector<unsigned int> line_start; line k is index[line_start[k] .. line_start[k+1])
+ * std::vector<unsigned char> closed; 1 if line k is a loop
+*/
+typedef struct contour_set
+{
+  std::vector<float> verts;
+  std::vector<unsigned int> index;
+  std::vector<unsigned int> line_start;
+  std::vector<unsigned char> closed;
+} contour_set;
+
+/**Number of polylines in the set
+*/
+inline int contour_lines (const contour_set* set)
+{
+  return set->line_start.empty() ? 0 : (int)set->line_start.size() - 1;
+}
+/**Stitch the iso-contour of the grid into polylines. out is cleared first.
+ * @param linear_interp false puts crossings at the edge midpoint
+*/
+void contour_extract (const field_grid* grid, float iso, bool linear_interp, contour_set* out);
+/**Douglas-Peucker simplification of every polyline. Loops stay closed.
+ * @param epsilon largest distance (world unit) a dropped vertex may be from the simplified line
+*/
+void contour_simplify (const contour_set* in, float epsilon, contour_set* out);
@@ -0,0 +1,230 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "contour_export.h", "contour.h"
+*/
+
+#include "contour_export.h"
+
+#include <string.h>
+#include <math.h>
+
+#define EXPORT_MAGIC "MBCS"
+#define EXPORT_VERSION 1
+//binary coordinates are fixed point, 1/16 world unit
+#define EXPORT_UNITS 16
+
+static void put_u32 (std::vector<unsigned char>* buf, unsigned int v)
+{
+  for (int k=0; k<4; k++)
+    buf->push_back ((unsigned char)(v >> (k * 8)));
+}
+
+static void put_varint (std::vector<unsigned char>* buf, unsigned int v)
+{
+  while (v >= 0x80)
+  {
+    buf->push_back ((unsigned char)(v | 0x80));
+    v >>= 7;
+  }
+  buf->push_back ((unsigned char)v);
+}
+
+/**Signed delta as varint, small magnitudes of either sign stay one byte
+*/
+static void put_delta (std::vector<unsigned char>* buf, int d)
+{
+  put_varint (buf, ((unsigned int)d << 1) ^ (unsigned int)(d >> 31));
+}
+
+/**Frame record without its length prefix
+*/
+static void encode_frame (const contour_set* set, int frame, std::vector<unsigned char>* buf)
+{
+  int px = 0, py = 0;
+
+  buf->clear();
+  put_varint (buf, (unsigned int)frame);
+  put_varint (buf, (unsigned int)contour_lines (set));
+  for (int l=0; l<contour_lines (set); l++)
+  {
+    unsigned int first = set->line_start[l];
+    unsigned int n = set->line_start[l+1] - first;
+    if (set->closed[l])
+      n--;
+    put_varint (buf, (n << 1) | (set->closed[l] ? 1u : 0u));
+    for (unsigned int k=0; k<n; k++)
+    {
+      const float* v = &set->verts[set->index[first + k] * 2];
+      int x = (int)lrintf (v[0] * EXPORT_UNITS);
+      int y = (int)lrintf (v[1] * EXPORT_UNITS);
+      put_delta (buf, x - px);
+      put_delta (buf, y - py);
+      px = x;
+      py = y;
+    }
+  }
+}
+
+static bool write_svg (const contour_export* ex, const contour_set* set, int frame)
+{
+  char path[1024];
+  snprintf (path, sizeof(path), ex->svg_pattern, frame);
+  FILE* file = fopen (path, "w");
+  if (file == NULL)
+    return false;
+  fprintf (file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%g\" height=\"%g\" viewBox=\"0 0 %g %g\">\n",
+           ex->width, ex->height, ex->width, ex->height);
+  for (int l=0; l<contour_lines (set); l++)
+  {
+    unsigned int first = set->line_start[l];
+    unsigned int n = set->line_start[l+1] - first;
+    if (set->closed[l])
+      n--;
+    fprintf (file, "<path fill=\"none\" stroke=\"#00ff00\" d=\"");
+    for (unsigned int k=0; k<n; k++)
+    {
+      const float* v = &set->verts[set->index[first + k] * 2];
+      fprintf (file, "%c%.2f %.2f", k == 0 ? 'M' : 'L', v[0], v[1]);
+    }
+    fprintf (file, set->closed[l] ? "Z\"/>\n" : "\"/>\n");
+  }
+  fprintf (file, "</svg>\n");
+  return fclose (file) == 0;
+}
+
+/**Writer thread: take the oldest ready slot, write it outside the lock, hand the slot back
+*/
+static void export_writer (contour_export* ex)
+{
+  std::vector<unsigned char> buf, prefix;
+
+  std::unique_lock<std::mutex> guard (ex->lock);
+  for (;;)
+  {
+    while (ex->ready_count == 0 && !ex->stop)
+      ex->wake_writer.wait (guard);
+    if (ex->ready_count == 0)
+      break;
+    int slot = ex->ready[ex->ready_head];
+    ex->ready_head = (ex->ready_head + 1) % (int)ex->ready.size();
+    ex->ready_count--;
+    guard.unlock();
+
+    const contour_set* set = &ex->slots[slot];
+    int frame = ex->slot_frame[slot];
+    bool ok = true;
+    if (ex->bin != NULL)
+    {
+      encode_frame (set, frame, &buf);
+      prefix.clear();
+      put_u32 (&prefix, (unsigned int)buf.size());
+      ok = fwrite (&prefix[0], 1, prefix.size(), ex->bin) == prefix.size() &&
+           (buf.empty() || fwrite (&buf[0], 1, buf.size(), ex->bin) == buf.size());
+    }
+    if (ex->svg_pattern != NULL)
+      ok = write_svg (ex, set, frame) && ok;
+
+    guard.lock();
+    if (!ok)
+      ex->failed++;
+    ex->free_slots.push_back (slot);
+    ex->wake_pusher.notify_one();
+  }
+}
+
+bool contour_export_open (contour_export* ex, const char* bin_path, const char* svg_pattern,
+                          float width, float height, int queue_frames, bool drop_when_full)
+{
+  if (queue_frames < 1)
+    queue_frames = 1;
+  ex->bin = NULL;
+  if (bin_path != NULL)
+  {
+    ex->bin = fopen (bin_path, "wb");
+    if (ex->bin == NULL)
+      return false;
+    std::vector<unsigned char> header (EXPORT_MAGIC, EXPORT_MAGIC + 4);
+    unsigned int w, h;
+    memcpy (&w, &width, sizeof(w));
+    memcpy (&h, &height, sizeof(h));
+    put_u32 (&header, EXPORT_VERSION);
+    put_u32 (&header, w);
+    put_u32 (&header, h);
+    put_u32 (&header, EXPORT_UNITS);
+    if (fwrite (&header[0], 1, header.size(), ex->bin) != header.size())
+    {
+      fclose (ex->bin);
+      ex->bin = NULL;
+      return false;
+    }
+  }
+  ex->svg_pattern = svg_pattern;
+  ex->width = width;
+  ex->height = height;
+  ex->drop_when_full = drop_when_full;
+  ex->slots.assign (queue_frames, contour_set());
+  ex->slot_frame.assign (queue_frames, 0);
+  ex->ready.assign (queue_frames, 0);
+  ex->ready_head = 0;
+  ex->ready_count = 0;
+  ex->free_slots.clear();
+  for (int s=queue_frames-1; s>=0; s--)
+    ex->free_slots.push_back (s);
+  ex->stop = false;
+  ex->frames = 0;
+  ex->dropped = 0;
+  ex->failed = 0;
+  ex->writer = std::thread (export_writer, ex);
+  return true;
+}
+
+bool contour_export_push (contour_export* ex, const contour_set* set)
+{
+  std::unique_lock<std::mutex> guard (ex->lock);
+  int frame = ex->frames++;
+  if (ex->free_slots.empty() && ex->drop_when_full)
+  {
+    ex->dropped++;
+    return false;
+  }
+  while (ex->free_slots.empty())
+    ex->wake_pusher.wait (guard);
+  int slot = ex->free_slots.back();
+  ex->free_slots.pop_back();
+  guard.unlock();
+
+  //assign keeps the slot capacity, no allocation once frames stop growing
+  contour_set* copy = &ex->slots[slot];
+  copy->verts.assign (set->verts.begin(), set->verts.end());
+  copy->index.assign (set->index.begin(), set->index.end());
+  copy->line_start.assign (set->line_start.begin(), set->line_start.end());
+  copy->closed.assign (set->closed.begin(), set->closed.end());
+  ex->slot_frame[slot] = frame;
+
+  guard.lock();
+  ex->ready[(ex->ready_head + ex->ready_count) % (int)ex->ready.size()] = slot;
+  ex->ready_count++;
+  ex->wake_writer.notify_one();
+  return true;
+}
+
+bool contour_export_close (contour_export* ex)
+{
+  {
+    std::lock_guard<std::mutex> guard (ex->lock);
+    ex->stop = true;
+    ex->wake_writer.notify_one();
+  }
+  if (ex->writer.joinable())
+    ex->writer.join();
+  if (ex->bin != NULL && fclose (ex->bin) != 0)
+    ex->failed++;
+  ex->bin = NULL;
+  ex->slots.clear();
+  return ex->failed == 0;
+}
+
+contour_export::~contour_export ()
+{
+  if (writer.joinable())
+    contour_export_close (this);
+}
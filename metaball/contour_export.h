@@ -0,0 +1,84 @@
+/**Author: Un Hou (Albert) Chan
+ * Streaming export of contour_set frames to a compact binary stream and/or SVG files.
+ * Dependancy: "contour.h"
+ *
+ * contour_export_push copies the frame into one of a fixed number of slots and returns;
+ * a background thread encodes and writes the slots in order. Slot vectors keep their
+ * capacity, so memory stops growing once the largest frame has been seen. When every
+ * slot is waiting to be written the push drops the frame and counts it, so the caller is
+ * never stalled; an exporter opened without drop_when_full waits for a slot instead.
+ *
+ * Binary stream, all integers little endian:
+ *   header: "MBCS", u32 version (1), f32 width, f32 height, u32 units per world unit (16)
+ *   frame:  u32 byte length of the rest of the frame, then varints:
+ *           frame number, line count, and per line (vertex count << 1 | closed) followed by
+ *           the vertices as zigzag deltas of x and y in 1/16 world unit, from the last
+ *           vertex written in the frame (the first from 0,0). A closed loop does not repeat
+ *           its first vertex.
+ * SVG: one file per frame, every line a stroked path, loops closed with Z.
+ * One thread pushes; frames are written in push order.
+*/
+#pragma once
+#include "contour.h"
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**FILE* bin; binary stream, NULL if not written
+ * const char* svg_pattern; printf pattern with the frame number, NULL if not written
+ * float width, height; SVG canvas
+ * bool drop_when_full; drop frames instead of waiting for a slot
+ * std::vector<contour_set> slots; frame copies
+ * std::vector<int> slot_frame; frame number held by every slot
+ * std::vector<int> ready; ring of slots waiting to be written, ready_head / ready_count
+ * std::vector<int> free_slots;
+ * int frames, dropped, failed; frames pushed / dropped, writes that failed
+ * The destructor closes an exporter still open, so returning early never destroys a
+ * running writer thread
+*/
+typedef struct contour_export
+{
+  FILE* bin;
+  const char* svg_pattern;
+  float width;
+  float height;
+  bool drop_when_full;
+  std::vector<contour_set> slots;
+  std::vector<int> slot_frame;
+  std::vector<int> ready;
+  int ready_head;
+  int ready_count;
+  std::vector<int> free_slots;
+  bool stop;
+  std::mutex lock;
+  std::condition_variable wake_writer;
+  std::condition_variable wake_pusher;
+  std::thread writer;
+  int frames;
+  int dropped;
+  int failed;
+
+  ~contour_export ();
+} contour_export;
+
+/**Open the outputs and start the writer thread
+ * @param bin_path binary stream file, NULL for none
+ * @param svg_pattern e.g. "out/meta%05d.svg", NULL for none. Must outlive the exporter
+ * @param width, height world size, for the header and the SVG canvas
+ * @param queue_frames number of slots, at least 1
+ * @param drop_when_full drop (and count) frames pushed while every slot is busy; false waits
+ * @return false if the binary file cannot be created or its header written
+*/
+bool contour_export_open (contour_export* ex, const char* bin_path, const char* svg_pattern,
+                          float width, float height, int queue_frames, bool drop_when_full);
+/**Queue the next frame
+ * @return false if it was dropped because every slot was busy
+*/
+bool contour_export_push (contour_export* ex, const contour_set* set);
+/**Write everything still queued, stop the writer and close the files
+ * @return false if any write failed
+*/
+bool contour_export_close (contour_export* ex);
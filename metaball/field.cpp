@@ -0,0 +1,129 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "field.h", "../aclib/parallel.h"
+*/
+
+#include "field.h"
+#include "../aclib/parallel.h"
+
+#include <stdlib.h>
+
+void field_grid_init (field_grid* grid)
+{
+  grid->cell_x = 0;
+  grid->cell_y = 0;
+  grid->stride = 0;
+  grid->width = 0.0f;
+  grid->height = 0.0f;
+  grid->cell_w = 0.0f;
+  grid->cell_h = 0.0f;
+  grid->data = NULL;
+}
+
+bool field_grid_resize (field_grid* grid, int cell_x, int cell_y, float width, float height)
+{
+  field_grid_free (grid);
+  if (cell_x < 1 || cell_y < 1 || width <= 0.0f || height <= 0.0f)
+    return false;
+
+  grid->data = (float*) calloc ((size_t)(cell_x + 1) * (size_t)(cell_y + 1), sizeof(float));
+  if (grid->data == NULL)
+    return false;
+  grid->cell_x = cell_x;
+  grid->cell_y = cell_y;
+  grid->stride = cell_x + 1;
+  grid->width = width;
+  grid->height = height;
+  grid->cell_w = width / (float)cell_x;
+  grid->cell_h = height / (float)cell_y;
+  return true;
+}
+
+void field_grid_free (field_grid* grid)
+{
+  free (grid->data);
+  field_grid_init (grid);
+}
+
+/**Evaluate corners [i0,i1) x [j0,j1). Ball loop is outside the corner loops so
+ * every ball makes one pass over a block that is already in cache, and the
+ * inner loop is a plain stride-1 float loop the compiler can vectorize.
+*/
+static void eval_tile (field_grid* grid, int i0, int i1, int j0, int j1,
+                       const float* bx, const float* by, const float* br2, int n)
+{
+  float xs[FIELD_TILE]; //X coordinate of each corner column in the tile
+  int w = i1 - i0;
+
+  for (int i=0; i<w; i++)
+    xs[i] = (float)(i0 + i) * grid->cell_w;
+  for (int j=j0; j<j1; j++)
+  {
+    float* row = grid->data + (size_t)j * grid->stride + i0;
+    for (int i=0; i<w; i++)
+      row[i] = 0.0f;
+  }
+  for (int b=0; b<n; b++)
+  {
+    float cx = bx[b];
+    float cy = by[b];
+    float r2 = br2[b];
+    for (int j=j0; j<j1; j++)
+    {
+      float* row = grid->data + (size_t)j * grid->stride + i0;
+      float dy = (float)j * grid->cell_h - cy;
+      float dy2 = dy * dy;
+      for (int i=0; i<w; i++)
+      {
+        float dx = xs[i] - cx;
+        row[i] += r2 / (dx * dx + dy2);
+      }
+    }
+  }
+}
+
+void field_grid_eval (field_grid* grid, const float* bx, const float* by, const float* br2, int n)
+{
+  int cols = grid->cell_x + 1;
+  int rows = grid->cell_y + 1;
+
+  for (int ty=0; ty<rows; ty+=FIELD_TILE)
+    for (int tx=0; tx<cols; tx+=FIELD_TILE)
+    {
+      int tx1 = tx + FIELD_TILE < cols ? tx + FIELD_TILE : cols;
+      int ty1 = ty + FIELD_TILE < rows ? ty + FIELD_TILE : rows;
+      eval_tile (grid, tx, tx1, ty, ty1, bx, by, br2, n);
+    }
+}
+
+void field_grid_eval_threads (field_grid* grid, const float* bx, const float* by, const float* br2, int n, int threads)
+{
+  int cols = grid->cell_x + 1;
+  int rows = grid->cell_y + 1;
+  int tiles_x = (cols + FIELD_TILE - 1) / FIELD_TILE;
+  int tiles_y = (rows + FIELD_TILE - 1) / FIELD_TILE;
+
+  aclib::parallel_for (tiles_x * tiles_y, threads, [&](int t)
+  {
+    int tx = t % tiles_x * FIELD_TILE;
+    int ty = t / tiles_x * FIELD_TILE;
+    int tx1 = tx + FIELD_TILE < cols ? tx + FIELD_TILE : cols;
+    int ty1 = ty + FIELD_TILE < rows ? ty + FIELD_TILE : rows;
+    eval_tile (grid, tx, tx1, ty, ty1, bx, by, br2, n);
+  });
+}
+
+float field_grid_eval_corner (const field_grid* grid, int i, int j, const float* bx, const float* by, const float* br2, int n)
+{
+  float x = (float)i * grid->cell_w;
+  float y = (float)j * grid->cell_h;
+  float sum = 0.0f;
+
+  for (int b=0; b<n; b++)
+  {
+    float dx = x - bx[b];
+    float dy = y - by[b];
+    float dy2 = dy * dy;
+    sum += br2[b] / (dx * dx + dy2);
+  }
+  return sum;
+}
@@ -0,0 +1,63 @@
+/**Author: Un Hou (Albert) Chan
+ * Metaball scalar field sampled on the marching squares grid.
+ * Dependancy: "../aclib/parallel.h"
+ *
+ * Corners are stored row-major: corner (i,j) lives at data[j*stride + i], so a
+ * scanline of corners is contiguous and matches the order draw_meta walks cells.
+ * Passes over the grid walk FIELD_TILE x FIELD_TILE blocks so the working set
+ * of one block (16KB of floats) stays in L1/L2.
+*/
+#pragma once
+
+#include <stddef.h>
+
+//corners per tile side. 64*64 floats = 16KB
+#define FIELD_TILE 64
+
+/**int cell_x, cell_y; number of cells. stride = cell_x+1 corners per row.
+ * float width, height; world size covered by the grid
+ * float cell_w, cell_h; size of one cell in world unit
+ * float* data; (cell_x+1)*(cell_y+1) corner values
+*/
+typedef struct field_grid
+{
+  int cell_x;
+  int cell_y;
+  int stride;
+  float width;
+  float height;
+  float cell_w;
+  float cell_h;
+  float* data;
+} field_grid;
+
+/**Initialize an empty grid. Must be called before field_grid_resize
+*/
+void field_grid_init (field_grid* grid);
+/**(Re)allocate the grid for a new cell count and world size. Old values are discarded.
+ * @return false if allocation failed or the size is invalid; the grid is left empty
+*/
+bool field_grid_resize (field_grid* grid, int cell_x, int cell_y, float width, float height);
+/**Release the grid memory
+*/
+void field_grid_free (field_grid* grid);
+/**Field value at corner (i,j)
+*/
+inline float field_grid_at (const field_grid* grid, int i, int j)
+{
+  return grid->data[j * grid->stride + i];
+}
+/**Evaluate sum(r^2/d^2) of every ball at every corner, tile by tile.
+ * @param bx, by ball centers
+ * @param br2 ball radius squared
+ * @param n number of balls
+*/
+void field_grid_eval (field_grid* grid, const float* bx, const float* by, const float* br2, int n);
+/**field_grid_eval with the tiles shared out over threads, same values
+ * @param threads <= 0 means one per hardware thread
+*/
+void field_grid_eval_threads (field_grid* grid, const float* bx, const float* by, const float* br2, int n, int threads);
+/**Evaluate a single corner, bit-identical to what field_grid_eval stores there.
+ * @return field value at corner (i,j); grid->data is not written
+*/
+float field_grid_eval_corner (const field_grid* grid, int i, int j, const float* bx, const float* by, const float* br2, int n);
@@ -0,0 +1,217 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "march.h", "field.h"
+*/
+
+#include "march.h"
+
+//polygon vertex codes: cell corners, then edge crossings
+#define V_00 0 //(x0, y0)
+#define V_10 1 //(x1, y0)
+#define V_01 2 //(x0, y1)
+#define V_11 3 //(x1, y1)
+#define V_T  4 //(tMid, y0) top edge
+#define V_L  5 //(x0, lMid) left edge
+#define V_B  6 //(bMid, y1) bottom edge
+#define V_R  7 //(x1, rMid) right edge
+
+/**Cell polygon per case, same vertex order draw_meta used with GL_POLYGON. -1 terminated.
+*/
+static const signed char cell_poly[16][7] =
+{
+  {-1},                                    //0x0  o o / o o
+  {V_00, V_L, V_T, -1},                    //0x1  x o / o o
+  {V_10, V_T, V_R, -1},                    //0x2  o x / o o
+  {V_00, V_L, V_R, V_10, -1},              //0x3  x x / o o
+  {V_01, V_B, V_L, -1},                    //0x4  o o / x o
+  {V_00, V_01, V_B, V_T, -1},              //0x5  x o / x o
+  {V_10, V_T, V_L, V_01, V_B, V_R, -1},    //0x6  o x / x o
+  {V_00, V_01, V_B, V_R, V_10, -1},        //0x7  x x / x o
+  {V_11, V_R, V_B, -1},                    //0x8  o o / o x
+  {V_00, V_L, V_B, V_11, V_R, V_T, -1},    //0x9  x o / o x
+  {V_10, V_T, V_B, V_11, -1},              //0xA  o x / o x
+  {V_00, V_L, V_B, V_11, V_10, -1},        //0xB  x x / o x
+  {V_01, V_11, V_R, V_L, -1},              //0xC  o o / x x
+  {V_00, V_01, V_11, V_R, V_T, -1},        //0xD  x o / x x
+  {V_10, V_T, V_L, V_01, V_11, -1},        //0xE  o x / x x
+  {V_00, V_01, V_11, V_10, -1}             //0xF  x x / x x
+};
+
+/**Edge crossings of the cell with corners p00..p11 at [x0,x0+cw]x[y0,y0+ch]
+ * @param mid receives tMid, lMid, bMid, rMid
+*/
+static inline void cell_crossings (float p00, float p10, float p01, float p11, float iso, bool linear_interp,
+                                   float x0, float y0, float cw, float ch, float* mid)
+{
+  if (linear_interp)
+  {
+    /*example
+     o o
+     o x
+     (yMid - y0)    iso - mat(x1,y0)
+     ----------- ~= -------------------------
+     (y1 - y0)      mat(x1,y1) - mat(x1,y0)
+    */
+    mid[0] = cw * (iso-p00)/(p10-p00) + x0;
+    mid[1] = ch * (iso-p00)/(p01-p00) + y0;
+    mid[2] = cw * (iso-p01)/(p11-p01) + x0;
+    mid[3] = ch * (iso-p10)/(p11-p10) + y0;
+  }
+  else
+  {
+    mid[0] = mid[2] = x0 + 0.5f * cw;
+    mid[1] = mid[3] = y0 + 0.5f * ch;
+  }
+}
+
+int march_cell (const field_grid* grid, int i, int j, float iso, bool linear_interp, float* out)
+{
+  unsigned char sqr = march_case (grid, i, j, iso);
+  if (sqr == 0)
+    return 0;
+
+  float cw = grid->cell_w;
+  float ch = grid->cell_h;
+  float x0 = (float)i * cw;
+  float y0 = (float)j * ch;
+  float x1 = (float)(i+1) * cw;
+  float y1 = (float)(j+1) * ch;
+  const float* r0 = grid->data + (size_t)j * grid->stride + i;
+  const float* r1 = r0 + grid->stride;
+  float mid[4];
+  cell_crossings (r0[0], r0[1], r1[0], r1[1], iso, linear_interp, x0, y0, cw, ch, mid);
+
+  return march_polygon (sqr, x0, y0, x1, y1, mid[0], mid[1], mid[2], mid[3], out);
+}
+
+int march_polygon (unsigned char sqr, float x0, float y0, float x1, float y1,
+                   float tMid, float lMid, float bMid, float rMid, float* out)
+{
+  float vx[8] = {x0, x1, x0, x1, tMid, x0, bMid, x1};
+  float vy[8] = {y0, y0, y1, y1, y0, lMid, y1, rMid};
+  const signed char* poly = cell_poly[sqr];
+  int n = 0;
+  //fan the convex cell polygon from its first vertex
+  for (int k=1; poly[k+1] >= 0; k++)
+  {
+    out[n*2+0] = vx[poly[0]];   out[n*2+1] = vy[poly[0]];   n++;
+    out[n*2+0] = vx[poly[k]];   out[n*2+1] = vy[poly[k]];   n++;
+    out[n*2+0] = vx[poly[k+1]]; out[n*2+1] = vy[poly[k+1]]; n++;
+  }
+  return n;
+}
+
+int march_segments (unsigned char sqr, int* seg)
+{
+  const signed char* poly = cell_poly[sqr];
+  int len = 0, n = 0;
+
+  while (len < 7 && poly[len] >= 0)
+    len++;
+  //consecutive polygon vertices that both sit on an edge are a piece of the contour
+  for (int k=0; k<len && len>0; k++)
+  {
+    int a = poly[k];
+    int b = poly[(k+1) % len];
+    if (a >= V_T && b >= V_T)
+    {
+      seg[n*2+0] = a - V_T;
+      seg[n*2+1] = b - V_T;
+      n++;
+    }
+  }
+  return n;
+}
+
+void march_grid (const field_grid* grid, float iso, bool linear_interp, std::vector<float>* tris)
+{
+  float cell[MARCH_MAX_VERTS * 2];
+
+  tris->clear();
+  for (int ty=0; ty<grid->cell_y; ty+=FIELD_TILE)
+    for (int tx=0; tx<grid->cell_x; tx+=FIELD_TILE)
+    {
+      int tx1 = tx + FIELD_TILE < grid->cell_x ? tx + FIELD_TILE : grid->cell_x;
+      int ty1 = ty + FIELD_TILE < grid->cell_y ? ty + FIELD_TILE : grid->cell_y;
+      for (int j=ty; j<ty1; j++)
+        for (int i=tx; i<tx1; i++)
+        {
+          int n = march_cell (grid, i, j, iso, linear_interp, cell);
+          if (n > 0)
+            tris->insert (tris->end(), cell, cell + n*2);
+        }
+    }
+}
+
+void march_bands (const field_grid* grid, const float* levels, int count, bool linear_interp,
+                  std::vector<float>* fill, std::vector<float>* lines)
+{
+  float cell[MARCH_MAX_VERTS * 2];
+  float cw = grid->cell_w;
+  float ch = grid->cell_h;
+
+  for (int l=0; l<count; l++)
+  {
+    fill[l].clear();
+    if (lines != NULL)
+      lines[l].clear();
+  }
+  for (int ty=0; ty<grid->cell_y; ty+=FIELD_TILE)
+    for (int tx=0; tx<grid->cell_x; tx+=FIELD_TILE)
+    {
+      int tx1 = tx + FIELD_TILE < grid->cell_x ? tx + FIELD_TILE : grid->cell_x;
+      int ty1 = ty + FIELD_TILE < grid->cell_y ? ty + FIELD_TILE : grid->cell_y;
+      for (int j=ty; j<ty1; j++)
+        for (int i=tx; i<tx1; i++)
+        {
+          //corners are read once for every level
+          const float* r0 = grid->data + (size_t)j * grid->stride + i;
+          const float* r1 = r0 + grid->stride;
+          float p00 = r0[0], p10 = r0[1], p01 = r1[0], p11 = r1[1];
+          float lo = p00 < p10 ? p00 : p10;
+          float hi = p00 < p10 ? p10 : p00;
+          lo = p01 < lo ? p01 : lo;
+          hi = p01 > hi ? p01 : hi;
+          lo = p11 < lo ? p11 : lo;
+          hi = p11 > hi ? p11 : hi;
+          float x0 = (float)i * cw;
+          float y0 = (float)j * ch;
+          float x1 = (float)(i+1) * cw;
+          float y1 = (float)(j+1) * ch;
+
+          //levels are sorted: all at or under lo cover the cell, only those in (lo, hi] cross it
+          int full = -1;
+          for (int l=0; l<count && levels[l] <= hi; l++)
+          {
+            float iso = levels[l];
+            if (iso <= lo)
+            {
+              full = l;
+              continue;
+            }
+            unsigned char sqr = (p00 >= iso ? 1:0) | (p10 >= iso ? 2:0) | (p01 >= iso ? 4:0) | (p11 >= iso ? 8:0);
+            float mid[4];
+            cell_crossings (p00, p10, p01, p11, iso, linear_interp, x0, y0, cw, ch, mid);
+            int n = march_polygon (sqr, x0, y0, x1, y1, mid[0], mid[1], mid[2], mid[3], cell);
+            fill[l].insert (fill[l].end(), cell, cell + n*2);
+            if (lines == NULL)
+              continue;
+            //edge code to crossing point: top, left, bottom, right
+            float ex[4] = {mid[0], x0, mid[2], x1};
+            float ey[4] = {y0, mid[1], y1, mid[3]};
+            int seg[4];
+            int segs = march_segments (sqr, seg);
+            for (int k=0; k<segs*2; k++)
+            {
+              lines[l].push_back (ex[seg[k]]);
+              lines[l].push_back (ey[seg[k]]);
+            }
+          }
+          //a covered cell only needs the top covering level, the ones under it are painted over
+          if (full >= 0)
+          {
+            int n = march_polygon (0xF, x0, y0, x1, y1, 0.0f, 0.0f, 0.0f, 0.0f, cell);
+            fill[full].insert (fill[full].end(), cell, cell + n*2);
+          }
+        }
+    }
+}
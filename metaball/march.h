@@ -0,0 +1,61 @@
+/**Author: Un Hou (Albert) Chan
+ * Marching squares over a field_grid. No OpenGL here: cells are turned into
+ * triangles (x,y pairs) that the caller uploads or rasterizes.
+ * Dependancy: "field.h"
+ *
+ * Corner bits of the case index:
+ * //====//
+ * //1  2//
+ * //4  8//
+ * //====//
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+//largest cell polygon is the 6 vertex saddle, fanned into 4 triangles
+#define MARCH_MAX_VERTS 12
+
+/**Case index of cell (i,j) for threshold iso
+*/
+inline unsigned char march_case (const field_grid* grid, int i, int j, float iso)
+{
+  const float* r0 = grid->data + (size_t)j * grid->stride + i;
+  const float* r1 = r0 + grid->stride;
+  return (r0[0] >= iso ? 1:0) | (r0[1] >= iso ? 2:0) | (r1[0] >= iso ? 4:0) | (r1[1] >= iso ? 8:0);
+}
+/**Triangulate the polygon of case sqr for the cell [x0,x1]x[y0,y1]
+ * @param tMid, bMid X of the top and bottom edge crossings
+ * @param lMid, rMid Y of the left and right edge crossings
+ * @param out room for MARCH_MAX_VERTS x,y pairs
+ * @return number of vertices written
+*/
+int march_polygon (unsigned char sqr, float x0, float y0, float x1, float y1,
+                   float tMid, float lMid, float bMid, float rMid, float* out);
+/**Contour segments of case sqr, oriented like the fill polygon (inside on the same side).
+ * Edges are coded 0 top, 1 left, 2 bottom, 3 right.
+ * @param seg room for 4 edge codes: segment k goes from seg[2k] to seg[2k+1]
+ * @return number of segments, 0 to 2
+*/
+int march_segments (unsigned char sqr, int* seg);
+/**Triangulate cell (i,j)
+ * @param out room for MARCH_MAX_VERTS x,y pairs
+ * @param linear_interp false puts edge crossings at the edge midpoint
+ * @return number of vertices written
+*/
+int march_cell (const field_grid* grid, int i, int j, float iso, bool linear_interp, float* out);
+/**Triangulate the whole grid tile by tile, appending to tris (x,y pairs, GL_TRIANGLES order).
+ * tris is cleared first; its capacity is kept between frames.
+*/
+void march_grid (const field_grid* grid, float iso, bool linear_interp, std::vector<float>* tris);
+/**Several thresholds in one pass: every cell reads its corners once, finds the levels
+ * that cross it and classifies only those.
+ * Level l fills the region where the field is >= levels[l], without the cells a higher
+ * level covers completely, so drawing fill[0], fill[1], ... in order paints the bands.
+ * @param levels sorted ascending
+ * @param fill count vectors: triangles of every level (x,y pairs, GL_TRIANGLES order)
+ * @param lines count vectors, or NULL: contour of every level as segments (x,y pairs, GL_LINES order)
+*/
+void march_bands (const field_grid* grid, const float* levels, int count, bool linear_interp,
+                  std::vector<float>* fill, std::vector<float>* lines);
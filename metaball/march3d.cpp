@@ -0,0 +1,328 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "march3d.h", "../aclib/parallel.h"
+*/
+
+#include "march3d.h"
+#include "../aclib/parallel.h"
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+//most triangle vertices a cube configuration produces (5 triangles, as in the classic table)
+#define MC_MAX_TRI_VERTS 15
+
+/*Cube corner c sits at (c&1, (c>>1)&1, (c>>2)&1). Edge e joins mc_edge_a[e] and mc_edge_b[e],
+ *which differ in exactly one bit.
+*/
+static int mc_edge_a[12];
+static int mc_edge_b[12];
+static unsigned char mc_tri_count[256];
+static signed char mc_tri[256][MC_MAX_TRI_VERTS];
+static bool mc_ready = false;
+
+/**Build the triangle table. For every configuration, walk each face counter clockwise
+ * (seen from outside the cube); an inside run of corners is closed by a segment from
+ * the edge where the run ends to the edge where it started. Adjacent faces walk their
+ * shared edge in opposite directions, so the segments chain into loops around the
+ * cube, which are then fanned into triangles.
+*/
+static void mc_build_tables ()
+{
+  int edge_id[8][8];
+  int face[6][4];
+  int e = 0, f = 0;
+
+  for (int c=0; c<8; c++)
+    for (int bit=1; bit<8; bit<<=1)
+      if (!(c & bit))
+      {
+        mc_edge_a[e] = c;
+        mc_edge_b[e] = c | bit;
+        edge_id[c][c | bit] = edge_id[c | bit][c] = e;
+        e++;
+      }
+  for (int axis=0; axis<3; axis++)
+  {
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    int su[4] = {0, 1, 1, 0};
+    int sv[4] = {0, 0, 1, 1};
+    for (int side=0; side<2; side++)
+    {
+      //u x v = axis, so (0,0) (1,0) (1,1) (0,1) is counter clockwise seen from +axis
+      for (int k=0; k<4; k++)
+      {
+        int kk = side ? k : 3 - k;
+        face[f][kk] = (side << axis) | (su[k] << u) | (sv[k] << v);
+      }
+      f++;
+    }
+  }
+
+  for (int cfg=0; cfg<256; cfg++)
+  {
+    int next[12];
+    for (int k=0; k<12; k++)
+      next[k] = -1;
+    for (f=0; f<6; f++)
+    {
+      int in[4];
+      for (int k=0; k<4; k++)
+        in[k] = (cfg >> face[f][k]) & 1;
+      for (int k=0; k<4; k++)
+      {
+        if (!(in[k] && !in[(k+1) % 4]))
+          continue;
+        //inside run ends on edge k, find the edge where it started
+        int m = (k + 3) % 4;
+        while (!(!in[m] && in[(m+1) % 4]))
+          m = (m + 3) % 4;
+        next[edge_id[face[f][k]][face[f][(k+1) % 4]]] = edge_id[face[f][m]][face[f][(m+1) % 4]];
+      }
+    }
+
+    int n = 0;
+    bool visited[12] = {false};
+    for (int start=0; start<12; start++)
+    {
+      if (next[start] < 0 || visited[start])
+        continue;
+      int loop[12], len = 0;
+      for (int k=start; !visited[k]; k=next[k])
+      {
+        visited[k] = true;
+        loop[len++] = k;
+      }
+      //the loop runs clockwise seen from the outside corners, fan it backwards
+      for (int k=1; k+1<len; k++)
+      {
+        mc_tri[cfg][n++] = (signed char)loop[0];
+        mc_tri[cfg][n++] = (signed char)loop[k+1];
+        mc_tri[cfg][n++] = (signed char)loop[k];
+      }
+    }
+    mc_tri_count[cfg] = (unsigned char)n;
+  }
+  mc_ready = true;
+}
+
+/**Everything a slab needs
+*/
+typedef struct slab_ctx
+{
+  const volume_grid* vol;
+  const float* bx;
+  const float* by;
+  const float* bz;
+  const float* br2;
+  int n;
+  float iso;
+  float cw, ch, cd; //cube size
+  int cols;         //corners per plane row, cell_x+1
+  std::vector<float> xs;
+} slab_ctx;
+
+/**Field on corner plane k, balls outside so every ball streams once over the plane
+*/
+static void eval_plane (const slab_ctx* c, int k, float* plane)
+{
+  int cols = c->cols;
+  int rows = c->vol->cell_y + 1;
+  float z = (float)k * c->cd;
+
+  memset (plane, 0, sizeof(float) * (size_t)cols * rows);
+  for (int b=0; b<c->n; b++)
+  {
+    float dz = z - c->bz[b];
+    float dz2 = dz * dz;
+    float cx = c->bx[b];
+    float r2 = c->br2[b];
+    for (int j=0; j<rows; j++)
+    {
+      float* row = plane + (size_t)j * cols;
+      float dy = (float)j * c->ch - c->by[b];
+      float dyz2 = dy * dy + dz2;
+      int i = 0;
+#ifdef __SSE2__
+      __m128 vcx = _mm_set1_ps (cx);
+      __m128 vr2 = _mm_set1_ps (r2);
+      __m128 vdyz2 = _mm_set1_ps (dyz2);
+      for (; i+4<=cols; i+=4)
+      {
+        __m128 dx = _mm_sub_ps (_mm_loadu_ps (&c->xs[i]), vcx);
+        __m128 d2 = _mm_add_ps (_mm_mul_ps (dx, dx), vdyz2);
+        _mm_storeu_ps (row + i, _mm_add_ps (_mm_loadu_ps (row + i), _mm_div_ps (vr2, d2)));
+      }
+#endif
+      for (; i<cols; i++)
+      {
+        float dx = c->xs[i] - cx;
+        row[i] += r2 / (dx * dx + dyz2);
+      }
+    }
+  }
+}
+
+/**Vertex on edge e of cube (i,j,k), normal from the analytic gradient
+*/
+static unsigned int make_vertex (const slab_ctx* c, const float* p0, const float* p1, int i, int j, int k, int e, mesh3d* out)
+{
+  int a = mc_edge_a[e];
+  int b = mc_edge_b[e];
+  const float* pa = (a & 4) ? p1 : p0;
+  const float* pb = (b & 4) ? p1 : p0;
+  float va = pa[(size_t)(j + ((a >> 1) & 1)) * c->cols + i + (a & 1)];
+  float vb = pb[(size_t)(j + ((b >> 1) & 1)) * c->cols + i + (b & 1)];
+  float t = (c->iso - va) / (vb - va);
+  int bit = a ^ b;
+  float x = ((float)(i + (a & 1)) + (bit == 1 ? t : 0.0f)) * c->cw;
+  float y = ((float)(j + ((a >> 1) & 1)) + (bit == 2 ? t : 0.0f)) * c->ch;
+  float z = ((float)(k + ((a >> 2) & 1)) + (bit == 4 ? t : 0.0f)) * c->cd;
+
+  //grad(r^2/d^2) = -2 r^2 d / d^4, the outward normal is -grad
+  float gx = 0.0f, gy = 0.0f, gz = 0.0f;
+  for (int q=0; q<c->n; q++)
+  {
+    float dx = x - c->bx[q];
+    float dy = y - c->by[q];
+    float dz = z - c->bz[q];
+    float d2 = dx * dx + dy * dy + dz * dz;
+    float s = c->br2[q] / (d2 * d2);
+    gx += s * dx;
+    gy += s * dy;
+    gz += s * dz;
+  }
+  float len = sqrtf (gx * gx + gy * gy + gz * gz);
+  float inv = len > 0.0f ? 1.0f / len : 0.0f;
+
+  unsigned int v = (unsigned int)(out->verts.size() / 3);
+  out->verts.push_back (x);
+  out->verts.push_back (y);
+  out->verts.push_back (z);
+  out->normals.push_back (gx * inv);
+  out->normals.push_back (gy * inv);
+  out->normals.push_back (gz * inv);
+  return v;
+}
+
+/**Cube layers [k0, k1) into out
+*/
+static void march_slab (const slab_ctx* c, int k0, int k1, mesh3d* out)
+{
+  int nx = c->vol->cell_x;
+  int ny = c->vol->cell_y;
+  int cols = c->cols;
+  size_t plane_size = (size_t)cols * (ny + 1);
+  std::vector<float> p0 (plane_size), p1 (plane_size);
+  //vertex index of the crossed edges: x edges and y edges of both planes, z edges between them
+  std::vector<int> ex0 ((size_t)nx * (ny + 1)), ex1 ((size_t)nx * (ny + 1));
+  std::vector<int> ey0 ((size_t)cols * ny), ey1 ((size_t)cols * ny);
+  std::vector<int> ez (plane_size);
+
+  out->verts.clear();
+  out->normals.clear();
+  out->index.clear();
+  eval_plane (c, k0, &p0[0]);
+  ex0.assign (ex0.size(), -1);
+  ey0.assign (ey0.size(), -1);
+  for (int k=k0; k<k1; k++)
+  {
+    eval_plane (c, k+1, &p1[0]);
+    ex1.assign (ex1.size(), -1);
+    ey1.assign (ey1.size(), -1);
+    ez.assign (ez.size(), -1);
+    for (int j=0; j<ny; j++)
+      for (int i=0; i<nx; i++)
+      {
+        size_t c0 = (size_t)j * cols + i;
+        size_t c1 = c0 + cols;
+        int cfg = (p0[c0]     >= c->iso ? 1 : 0)   | (p0[c0 + 1] >= c->iso ? 2 : 0) |
+                  (p0[c1]     >= c->iso ? 4 : 0)   | (p0[c1 + 1] >= c->iso ? 8 : 0) |
+                  (p1[c0]     >= c->iso ? 16 : 0)  | (p1[c0 + 1] >= c->iso ? 32 : 0) |
+                  (p1[c1]     >= c->iso ? 64 : 0)  | (p1[c1 + 1] >= c->iso ? 128 : 0);
+        for (int t=0; t<mc_tri_count[cfg]; t++)
+        {
+          int e = mc_tri[cfg][t];
+          int a = mc_edge_a[e];
+          int ax = a & 1, ay = (a >> 1) & 1, az = (a >> 2) & 1;
+          int* slot;
+          switch (a ^ mc_edge_b[e])
+          {
+            case 1:
+              slot = &(az ? ex1 : ex0)[(size_t)(j + ay) * nx + i];
+            break;
+            case 2:
+              slot = &(az ? ey1 : ey0)[(size_t)j * cols + i + ax];
+            break;
+            default:
+              slot = &ez[(size_t)(j + ay) * cols + i + ax];
+            break;
+          }
+          if (*slot < 0)
+            *slot = (int)make_vertex (c, &p0[0], &p1[0], i, j, k, e, out);
+          out->index.push_back ((unsigned int)*slot);
+        }
+      }
+    p0.swap (p1);
+    ex0.swap (ex1);
+    ey0.swap (ey1);
+  }
+}
+
+void march3d_volume (const volume_grid* vol, const float* bx, const float* by, const float* bz, const float* br2, int n,
+                     float iso, int threads, mesh3d* out)
+{
+  if (!mc_ready)
+    mc_build_tables ();
+  out->verts.clear();
+  out->normals.clear();
+  out->index.clear();
+  if (vol->cell_x < 1 || vol->cell_y < 1 || vol->cell_z < 1)
+    return;
+
+  slab_ctx c;
+  c.vol = vol;
+  c.bx = bx;
+  c.by = by;
+  c.bz = bz;
+  c.br2 = br2;
+  c.n = n;
+  c.iso = iso;
+  c.cw = vol->width / (float)vol->cell_x;
+  c.ch = vol->height / (float)vol->cell_y;
+  c.cd = vol->depth / (float)vol->cell_z;
+  c.cols = vol->cell_x + 1;
+  c.xs.resize (c.cols + 4);
+  for (int i=0; i<c.cols; i++)
+    c.xs[i] = (float)i * c.cw;
+
+  if (threads <= 0)
+    threads = aclib::hardware_threads();
+  if (threads > vol->cell_z)
+    threads = vol->cell_z;
+  std::vector<mesh3d> parts (threads);
+  aclib::parallel_for (threads, threads, [&](int t){
+    march_slab (&c, vol->cell_z * t / threads, vol->cell_z * (t + 1) / threads, &parts[t]);
+  });
+
+  size_t nv = 0, ni = 0;
+  for (int t=0; t<threads; t++)
+  {
+    nv += parts[t].verts.size();
+    ni += parts[t].index.size();
+  }
+  out->verts.reserve (nv);
+  out->normals.reserve (nv);
+  out->index.reserve (ni);
+  for (int t=0; t<threads; t++)
+  {
+    unsigned int base = (unsigned int)(out->verts.size() / 3);
+    out->verts.insert (out->verts.end(), parts[t].verts.begin(), parts[t].verts.end());
+    out->normals.insert (out->normals.end(), parts[t].normals.begin(), parts[t].normals.end());
+    for (size_t k=0; k<parts[t].index.size(); k++)
+      out->index.push_back (parts[t].index[k] + base);
+  }
+}
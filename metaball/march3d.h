@@ -0,0 +1,49 @@
+/**Author: Un Hou (Albert) Chan
+ * 3D metaballs: marching cubes over a volume, in parallel z-slabs.
+ * Dependancy: "../aclib/parallel.h"
+ *
+ * Each slab walks its layers of cubes with two z-planes of field values live, and
+ * keeps the vertex index of every crossed edge of those planes, so the cubes that
+ * share an edge share its vertex. Planes are evaluated with SSE when available.
+ * Slab meshes are concatenated at the end; the plane between two slabs is emitted
+ * by both, so its vertices appear twice.
+ *
+ * The triangle table is built at first use from face-consistent loops: on every cube
+ * face the inside corners are kept apart on ambiguous (saddle) faces, so the two cubes
+ * sharing a face always agree and the surface is watertight.
+*/
+#pragma once
+
+#include <vector>
+
+/**int cell_x, cell_y, cell_z; number of cubes per axis
+ * float width, height, depth; world size covered by the volume, starting at the origin
+*/
+typedef struct volume_grid
+{
+  int cell_x;
+  int cell_y;
+  int cell_z;
+  float width;
+  float height;
+  float depth;
+} volume_grid;
+
+/**std::vector<float> verts, normals; x,y,z triples. Normals point out of the blobs
+ * std::vector<unsigned int> index; triangles, counter clockwise seen from outside
+*/
+typedef struct mesh3d
+{
+  std::vector<float> verts;
+  std::vector<float> normals;
+  std::vector<unsigned int> index;
+} mesh3d;
+
+/**Polygonize the iso-surface of sum(r^2/d^2) over the volume.
+ * @param bx, by, bz ball centers
+ * @param br2 ball radius squared
+ * @param threads number of slabs / threads, <= 0 for one per hardware thread
+ * @param out cleared, then filled
+*/
+void march3d_volume (const volume_grid* vol, const float* bx, const float* by, const float* bz, const float* br2, int n,
+                     float iso, int threads, mesh3d* out);
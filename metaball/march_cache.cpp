@@ -0,0 +1,204 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "march_cache.h", "march.h", "field.h"
+*/
+
+#include "march_cache.h"
+#include "march.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void march_cache_init (march_cache* cache)
+{
+  cache->cell_x = 0;
+  cache->cell_y = 0;
+  cache->cell_w = 0.0f;
+  cache->cell_h = 0.0f;
+  cache->tiles_x = 0;
+  cache->tiles_y = 0;
+  cache->iso = 0.0f;
+  cache->linear_interp = false;
+  cache->cases = NULL;
+  cache->edge_h = NULL;
+  cache->edge_v = NULL;
+  cache->tile_tris = NULL;
+  cache->dirty = NULL;
+  cache->rebuilt = false;
+  cache->changed_cases = 0;
+  cache->moved_edges = 0;
+  cache->dirty_tiles = 0;
+}
+
+void march_cache_free (march_cache* cache)
+{
+  free (cache->cases);
+  free (cache->edge_h);
+  free (cache->edge_v);
+  free (cache->dirty);
+  delete [] cache->tile_tris;
+  march_cache_init (cache);
+}
+
+/**Start over for a new grid shape or new parameters. Every case and crossing is
+ * invalid so the next pass marks every cell dirty.
+*/
+static bool cache_reset (march_cache* cache, const field_grid* grid, float iso, bool linear_interp)
+{
+  march_cache_free (cache);
+  size_t cells = (size_t)grid->cell_x * (size_t)grid->cell_y;
+  size_t h_edges = (size_t)grid->cell_x * (size_t)(grid->cell_y + 1);
+  size_t v_edges = (size_t)grid->stride * (size_t)grid->cell_y;
+
+  cache->tiles_x = (grid->cell_x + MARCH_CACHE_TILE - 1) / MARCH_CACHE_TILE;
+  cache->tiles_y = (grid->cell_y + MARCH_CACHE_TILE - 1) / MARCH_CACHE_TILE;
+  cache->cases = (unsigned char*) malloc (cells);
+  cache->edge_h = (float*) malloc (h_edges * sizeof(float));
+  cache->edge_v = (float*) malloc (v_edges * sizeof(float));
+  cache->dirty = (unsigned char*) malloc ((size_t)cache->tiles_x * cache->tiles_y);
+  cache->tile_tris = new std::vector<float>[(size_t)cache->tiles_x * cache->tiles_y];
+  if (!cache->cases || !cache->edge_h || !cache->edge_v || !cache->dirty)
+  {
+    march_cache_free (cache);
+    return false;
+  }
+  memset (cache->cases, 0xFF, cells); //no real case is 0xFF
+  for (size_t k=0; k<h_edges; k++)
+    cache->edge_h[k] = -1.0f;
+  for (size_t k=0; k<v_edges; k++)
+    cache->edge_v[k] = -1.0f;
+  cache->cell_x = grid->cell_x;
+  cache->cell_y = grid->cell_y;
+  cache->cell_w = grid->cell_w;
+  cache->cell_h = grid->cell_h;
+  cache->iso = iso;
+  cache->linear_interp = linear_interp;
+  return true;
+}
+
+/**Flag the block of cell (i,j); cells outside the grid are ignored
+*/
+static inline void mark_cell (march_cache* cache, int i, int j)
+{
+  if (i < 0 || j < 0 || i >= cache->cell_x || j >= cache->cell_y)
+    return;
+  cache->dirty[(j / MARCH_CACHE_TILE) * cache->tiles_x + i / MARCH_CACHE_TILE] = 1;
+}
+
+/**Update one cached crossing between corner values a and b
+ * @return true if it moved more than tol (fraction of the edge) or was not crossed before
+*/
+static inline bool update_edge (float* e, float a, float b, float iso, bool linear_interp, float tol)
+{
+  if ((a >= iso) == (b >= iso))
+  {
+    *e = -1.0f; //the case change of the cells takes care of the geometry
+    return false;
+  }
+  float f = linear_interp ? (iso - a) / (b - a) : 0.5f;
+  if (*e < 0.0f || fabsf (f - *e) > tol)
+  {
+    *e = f;
+    return true;
+  }
+  return false;
+}
+
+/**Re-emit the block from the cached cases and crossings
+*/
+static void emit_tile (march_cache* cache, const field_grid* grid, int tx, int ty)
+{
+  std::vector<float>* tris = &cache->tile_tris[ty * cache->tiles_x + tx];
+  float cell[MARCH_MAX_VERTS * 2];
+  int i0 = tx * MARCH_CACHE_TILE;
+  int j0 = ty * MARCH_CACHE_TILE;
+  int i1 = i0 + MARCH_CACHE_TILE < cache->cell_x ? i0 + MARCH_CACHE_TILE : cache->cell_x;
+  int j1 = j0 + MARCH_CACHE_TILE < cache->cell_y ? j0 + MARCH_CACHE_TILE : cache->cell_y;
+
+  tris->clear();
+  for (int j=j0; j<j1; j++)
+    for (int i=i0; i<i1; i++)
+    {
+      unsigned char sqr = cache->cases[(size_t)j * cache->cell_x + i];
+      if (sqr == 0)
+        continue;
+      float x0 = (float)i * grid->cell_w;
+      float y0 = (float)j * grid->cell_h;
+      float x1 = (float)(i+1) * grid->cell_w;
+      float y1 = (float)(j+1) * grid->cell_h;
+      float tMid = x0 + cache->edge_h[(size_t)j * cache->cell_x + i] * grid->cell_w;
+      float bMid = x0 + cache->edge_h[(size_t)(j+1) * cache->cell_x + i] * grid->cell_w;
+      float lMid = y0 + cache->edge_v[(size_t)j * grid->stride + i] * grid->cell_h;
+      float rMid = y0 + cache->edge_v[(size_t)j * grid->stride + i + 1] * grid->cell_h;
+      int n = march_polygon (sqr, x0, y0, x1, y1, tMid, lMid, bMid, rMid, cell);
+      tris->insert (tris->end(), cell, cell + n*2);
+    }
+}
+
+int march_cache_update (march_cache* cache, const field_grid* grid, float iso, bool linear_interp, float tolerance)
+{
+  cache->rebuilt = false;
+  if (cache->cases == NULL || cache->cell_x != grid->cell_x || cache->cell_y != grid->cell_y ||
+      cache->cell_w != grid->cell_w || cache->cell_h != grid->cell_h || cache->iso != iso || cache->linear_interp != linear_interp)
+  {
+    if (!cache_reset (cache, grid, iso, linear_interp))
+      return 0;
+    cache->rebuilt = true;
+  }
+  memset (cache->dirty, 0, (size_t)cache->tiles_x * cache->tiles_y);
+  cache->changed_cases = 0;
+  cache->moved_edges = 0;
+  cache->dirty_tiles = 0;
+
+  float tol_h = tolerance / grid->cell_w;
+  float tol_v = tolerance / grid->cell_h;
+  int cx = grid->cell_x;
+  int cy = grid->cell_y;
+  //horizontal edges, one corner row at a time
+  for (int j=0; j<=cy; j++)
+  {
+    const float* row = grid->data + (size_t)j * grid->stride;
+    float* e = cache->edge_h + (size_t)j * cx;
+    for (int i=0; i<cx; i++)
+      if (update_edge (&e[i], row[i], row[i+1], iso, linear_interp, tol_h))
+      {
+        cache->moved_edges++;
+        mark_cell (cache, i, j-1);
+        mark_cell (cache, i, j);
+      }
+  }
+  //vertical edges and cases, one cell row at a time
+  for (int j=0; j<cy; j++)
+  {
+    const float* r0 = grid->data + (size_t)j * grid->stride;
+    const float* r1 = r0 + grid->stride;
+    float* e = cache->edge_v + (size_t)j * grid->stride;
+    unsigned char* cases = cache->cases + (size_t)j * cx;
+    for (int i=0; i<=cx; i++)
+      if (update_edge (&e[i], r0[i], r1[i], iso, linear_interp, tol_v))
+      {
+        cache->moved_edges++;
+        mark_cell (cache, i-1, j);
+        mark_cell (cache, i, j);
+      }
+    for (int i=0; i<cx; i++)
+    {
+      unsigned char sqr = (r0[i] >= iso ? 1:0) | (r0[i+1] >= iso ? 2:0) | (r1[i] >= iso ? 4:0) | (r1[i+1] >= iso ? 8:0);
+      if (sqr != cases[i])
+      {
+        cases[i] = sqr;
+        cache->changed_cases++;
+        mark_cell (cache, i, j);
+      }
+    }
+  }
+
+  for (int ty=0; ty<cache->tiles_y; ty++)
+    for (int tx=0; tx<cache->tiles_x; tx++)
+      if (cache->dirty[ty * cache->tiles_x + tx])
+      {
+        emit_tile (cache, grid, tx, ty);
+        cache->dirty_tiles++;
+      }
+  return cache->dirty_tiles;
+}
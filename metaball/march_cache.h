@@ -0,0 +1,58 @@
+/**Author: Un Hou (Albert) Chan
+ * Marching squares with a persistent cell cache, for frames where most cells keep their case.
+ * Dependancy: "field.h", "march.h"
+ *
+ * The cache keeps the case of every cell and the crossing of every grid edge (as a
+ * fraction along the edge, shared by the two cells on either side). After each field
+ * update a cell is dirty only if its case changed or one of its crossings moved more
+ * than the tolerance. Geometry is kept per MARCH_CACHE_TILE x MARCH_CACHE_TILE block of
+ * cells and only blocks holding a dirty cell are re-emitted, from the cached crossings,
+ * so neighbours always agree on shared edges. Callers upload only the dirty blocks.
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+//cells per cache block side
+#define MARCH_CACHE_TILE 16
+
+/**int cell_x, cell_y; grid shape the cache was built for
+ * float cell_w, cell_h; cell size the geometry was emitted with
+ * int tiles_x, tiles_y; blocks per row / column
+ * unsigned char* cases; last case of every cell, row-major
+ * float* edge_h; crossing of horizontal edge (i,j)-(i+1,j), cell_x per corner row. -1 if not crossed
+ * float* edge_v; crossing of vertical edge (i,j)-(i,j+1), stride per cell row. -1 if not crossed
+ * std::vector<float>* tile_tris; triangles of every block, x,y pairs
+ * unsigned char* dirty; blocks re-emitted by the last update
+ * bool rebuilt; last update started from scratch (shape or parameters changed), every block is dirty
+ * int changed_cases, moved_edges, dirty_tiles; counters of the last update
+*/
+typedef struct march_cache
+{
+  int cell_x;
+  int cell_y;
+  float cell_w;
+  float cell_h;
+  int tiles_x;
+  int tiles_y;
+  float iso;
+  bool linear_interp;
+  unsigned char* cases;
+  float* edge_h;
+  float* edge_v;
+  std::vector<float>* tile_tris;
+  unsigned char* dirty;
+  bool rebuilt;
+  int changed_cases;
+  int moved_edges;
+  int dirty_tiles;
+} march_cache;
+
+void march_cache_init (march_cache* cache);
+void march_cache_free (march_cache* cache);
+/**Reclassify the grid and re-emit the blocks that changed.
+ * @param tolerance how far (world unit) a crossing may drift before its cells are re-emitted
+ * @return number of dirty blocks
+*/
+int march_cache_update (march_cache* cache, const field_grid* grid, float iso, bool linear_interp, float tolerance);
@@ -0,0 +1,247 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "narrow_band.h", "field.h", "march.h"
+*/
+
+#include "narrow_band.h"
+#include "march.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void narrow_band_init (narrow_band* nb)
+{
+  nb->cell_x = 0;
+  nb->cell_y = 0;
+  nb->band = NARROW_BAND_WIDTH;
+  nb->refresh = NARROW_BAND_REFRESH;
+  nb->corner_stamp = NULL;
+  nb->cell_stamp = NULL;
+  nb->block_stamp = NULL;
+  nb->blocks_x = 0;
+  nb->blocks_y = 0;
+  nb->frame = 0;
+  nb->crossing.clear();
+  nb->work.clear();
+  nb->since_refresh = 0;
+  nb->evals = 0;
+  nb->full = false;
+}
+
+void narrow_band_free (narrow_band* nb)
+{
+  int band = nb->band, refresh = nb->refresh;
+  free (nb->corner_stamp);
+  free (nb->cell_stamp);
+  free (nb->block_stamp);
+  narrow_band_init (nb);
+  nb->band = band;
+  nb->refresh = refresh;
+}
+
+void narrow_band_reset (narrow_band* nb)
+{
+  nb->since_refresh = nb->refresh;
+}
+
+/**Put cell into the band, once per frame
+*/
+static inline void add_cell (narrow_band* nb, int cell)
+{
+  if (nb->cell_stamp[cell] == nb->frame)
+    return;
+  nb->cell_stamp[cell] = nb->frame;
+  nb->block_stamp[(cell / nb->cell_x) / NARROW_BAND_BLOCK * nb->blocks_x + (cell % nb->cell_x) / NARROW_BAND_BLOCK] = nb->frame;
+  nb->work.push_back (cell);
+}
+
+/**Put every cell of [i-r, i+r] x [j-r, j+r] into the band
+*/
+static void add_box (narrow_band* nb, int i, int j, int r)
+{
+  int i0 = i - r < 0 ? 0 : i - r;
+  int j0 = j - r < 0 ? 0 : j - r;
+  int i1 = i + r >= nb->cell_x ? nb->cell_x - 1 : i + r;
+  int j1 = j + r >= nb->cell_y ? nb->cell_y - 1 : j + r;
+  for (int y=j0; y<=j1; y++)
+    for (int x=i0; x<=i1; x++)
+      add_cell (nb, y * nb->cell_x + x);
+}
+
+/**true if the field may cross iso somewhere in the box: the nearest distance to every
+ * ball gives an upper bound of the field, the farthest a lower bound
+*/
+static bool box_may_cross (const float* bx, const float* by, const float* br2, int n, float iso,
+                           float x0, float y0, float x1, float y1)
+{
+  float lo = 0.0f, hi = 0.0f;
+
+  for (int b=0; b<n; b++)
+  {
+    float nx = fmaxf (fmaxf (x0 - bx[b], bx[b] - x1), 0.0f);
+    float ny = fmaxf (fmaxf (y0 - by[b], by[b] - y1), 0.0f);
+    float fx = fmaxf (fabsf (bx[b] - x0), fabsf (bx[b] - x1));
+    float fy = fmaxf (fabsf (by[b] - y0), fabsf (by[b] - y1));
+    float near2 = nx * nx + ny * ny;
+    if (near2 <= 0.0f)
+      return true; //ball center inside the box
+    hi += br2[b] / near2;
+    lo += br2[b] / (fx * fx + fy * fy);
+  }
+  return lo < iso && hi >= iso;
+}
+
+/**Evaluate the queued cells from work[w] on; a crossing cell pulls in its neighbours,
+ * so the contour is followed past the band edge
+*/
+static size_t run_work (narrow_band* nb, field_grid* grid, size_t w, const float* bx, const float* by, const float* br2, int n, float iso)
+{
+  for (; w<nb->work.size(); w++)
+  {
+    int i = nb->work[w] % grid->cell_x;
+    int j = nb->work[w] / grid->cell_x;
+    for (int c=0; c<4; c++)
+    {
+      int ci = i + (c & 1);
+      int cj = j + (c >> 1);
+      size_t corner = (size_t)cj * grid->stride + ci;
+      if (nb->corner_stamp[corner] == nb->frame)
+        continue;
+      nb->corner_stamp[corner] = nb->frame;
+      grid->data[corner] = field_grid_eval_corner (grid, ci, cj, bx, by, br2, n);
+      nb->evals++;
+    }
+    unsigned char sqr = march_case (grid, i, j, iso);
+    if (sqr == 0 || sqr == 0xF)
+      continue;
+    nb->crossing.push_back (nb->work[w]);
+    add_box (nb, i, j, 1);
+  }
+  return w;
+}
+
+static void full_update (narrow_band* nb, field_grid* grid, const float* bx, const float* by, const float* br2, int n, float iso)
+{
+  field_grid_eval (grid, bx, by, br2, n);
+  nb->crossing.clear();
+  for (int j=0; j<grid->cell_y; j++)
+    for (int i=0; i<grid->cell_x; i++)
+    {
+      unsigned char sqr = march_case (grid, i, j, iso);
+      if (sqr != 0 && sqr != 0xF)
+        nb->crossing.push_back (j * grid->cell_x + i);
+    }
+  nb->since_refresh = 0;
+  nb->evals = (grid->cell_x + 1) * (grid->cell_y + 1);
+  nb->full = true;
+}
+
+int narrow_band_update (narrow_band* nb, field_grid* grid, const float* bx, const float* by, const float* br2, int n, float iso)
+{
+  size_t corners = (size_t)grid->stride * (grid->cell_y + 1);
+  size_t cells = (size_t)grid->cell_x * grid->cell_y;
+
+  if (nb->cell_x != grid->cell_x || nb->cell_y != grid->cell_y)
+  {
+    narrow_band_free (nb);
+    nb->corner_stamp = (unsigned int*) calloc (corners, sizeof(unsigned int));
+    nb->cell_stamp = (unsigned int*) calloc (cells, sizeof(unsigned int));
+    nb->blocks_x = (grid->cell_x + NARROW_BAND_BLOCK - 1) / NARROW_BAND_BLOCK;
+    nb->blocks_y = (grid->cell_y + NARROW_BAND_BLOCK - 1) / NARROW_BAND_BLOCK;
+    nb->block_stamp = (unsigned int*) calloc ((size_t)nb->blocks_x * nb->blocks_y, sizeof(unsigned int));
+    nb->cell_x = grid->cell_x;
+    nb->cell_y = grid->cell_y;
+    nb->since_refresh = nb->refresh;
+  }
+  if (nb->corner_stamp == NULL || nb->cell_stamp == NULL || nb->block_stamp == NULL || nb->since_refresh >= nb->refresh)
+  {
+    full_update (nb, grid, bx, by, br2, n, iso);
+    return nb->evals;
+  }
+  nb->since_refresh++;
+  nb->full = false;
+  nb->evals = 0;
+  nb->frame++;
+  if (nb->frame == 0)
+  {
+    memset (nb->corner_stamp, 0, corners * sizeof(unsigned int));
+    memset (nb->cell_stamp, 0, cells * sizeof(unsigned int));
+    memset (nb->block_stamp, 0, (size_t)nb->blocks_x * nb->blocks_y * sizeof(unsigned int));
+    nb->frame = 1;
+  }
+
+  //seed: around last frame's contour, and around every ball center
+  nb->work.clear();
+  for (size_t c=0; c<nb->crossing.size(); c++)
+    add_box (nb, nb->crossing[c] % grid->cell_x, nb->crossing[c] / grid->cell_x, nb->band);
+  for (int b=0; b<n; b++)
+  {
+    int i = (int)(bx[b] / grid->cell_w);
+    int j = (int)(by[b] / grid->cell_h);
+    if (i >= 0 && j >= 0 && i < grid->cell_x && j < grid->cell_y)
+      add_box (nb, i, j, nb->band);
+  }
+
+  nb->crossing.clear();
+  size_t done = run_work (nb, grid, 0, bx, by, br2, n, iso);
+  //blocks the band never reached can still grow a new island or hole (blobs nearly meeting);
+  //the ones whose field bounds straddle iso join the band
+  for (int by0=0; by0<nb->blocks_y; by0++)
+    for (int bx0=0; bx0<nb->blocks_x; bx0++)
+    {
+      if (nb->block_stamp[by0 * nb->blocks_x + bx0] == nb->frame)
+        continue;
+      int i0 = bx0 * NARROW_BAND_BLOCK, j0 = by0 * NARROW_BAND_BLOCK;
+      int i1 = i0 + NARROW_BAND_BLOCK < grid->cell_x ? i0 + NARROW_BAND_BLOCK : grid->cell_x;
+      int j1 = j0 + NARROW_BAND_BLOCK < grid->cell_y ? j0 + NARROW_BAND_BLOCK : grid->cell_y;
+      if (!box_may_cross (bx, by, br2, n, iso, (float)i0 * grid->cell_w, (float)j0 * grid->cell_h,
+                          (float)i1 * grid->cell_w, (float)j1 * grid->cell_h))
+        continue;
+      for (int j=j0; j<j1; j++)
+        for (int i=i0; i<i1; i++)
+          add_cell (nb, j * grid->cell_x + i);
+    }
+  run_work (nb, grid, done, bx, by, br2, n, iso);
+
+  //everything else: no crossed edge, so a corner is on the side of its evaluated row neighbour
+  float inside = iso * 2.0f;
+  int rows = grid->cell_y + 1;
+  std::vector<signed char> row_known (rows, 0);
+  for (int j=0; j<rows; j++)
+  {
+    float* row = grid->data + (size_t)j * grid->stride;
+    const unsigned int* stamp = nb->corner_stamp + (size_t)j * grid->stride;
+    int first = 0;
+    while (first < grid->stride && stamp[first] != nb->frame)
+      first++;
+    if (first == grid->stride)
+      continue;
+    row_known[j] = 1;
+    bool in = row[first] >= iso;
+    for (int i=0; i<grid->stride; i++)
+    {
+      if (stamp[i] == nb->frame)
+        in = row[i] >= iso;
+      else
+        row[i] = in ? inside : 0.0f;
+    }
+  }
+  //rows without an evaluated corner copy the side of the row above, then below
+  for (int pass=0; pass<2; pass++)
+    for (int k=1; k<rows; k++)
+    {
+      int j = pass == 0 ? k : rows - 1 - k;
+      int from = pass == 0 ? j - 1 : j + 1;
+      if (row_known[j] || !row_known[from])
+        continue;
+      float* row = grid->data + (size_t)j * grid->stride;
+      const float* src = grid->data + (size_t)from * grid->stride;
+      for (int i=0; i<grid->stride; i++)
+        row[i] = src[i] >= iso ? inside : 0.0f;
+      row_known[j] = 1;
+    }
+  //nothing evaluated at all: no balls on the grid
+  if (!row_known[0])
+    memset (grid->data, 0, corners * sizeof(float));
+  return nb->evals;
+}
@@ -0,0 +1,65 @@
+/**Author: Un Hou (Albert) Chan
+ * Narrow-band field evaluation: balls move a little per frame, so the contour stays
+ * close to where it was.
+ * Dependancy: "field.h", "march.h"
+ *
+ * Each update evaluates only the corners of cells within `band` cells of last frame's
+ * crossing cells, plus the cells around every ball center. When a crossing cell is on
+ * the edge of that band, the band grows around it until the contour is enclosed. The
+ * other corners cannot be on a crossed edge, so each keeps the side (inside/outside) of
+ * the nearest evaluated corner on its row, found by one scanline pass, and gets a
+ * placeholder value. Blocks the band does not touch join it only if conservative field
+ * bounds say a new island or hole could be there. A full evaluation every `refresh`
+ * frames catches anything the band still missed.
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+//default band half width (cell) and full refresh period (frame)
+#define NARROW_BAND_WIDTH 2
+#define NARROW_BAND_REFRESH 60
+//cells per side of the blocks checked for contour the band has not reached
+#define NARROW_BAND_BLOCK 16
+
+/**int cell_x, cell_y; grid shape the band was built for
+ * int band, refresh; see above, set after narrow_band_init
+ * unsigned int* corner_stamp, *cell_stamp, *block_stamp; corner evaluated / cell in band /
+ *   block touched by the band when stamp == frame
+ * int blocks_x, blocks_y; NARROW_BAND_BLOCK blocks per row / column
+ * std::vector<int> crossing; cells crossed by the contour after the last update
+ * std::vector<int> work; cells waiting to join the band
+ * int since_refresh; frames since the last full evaluation
+ * int evals; corners evaluated by the last update
+ * bool full; the last update evaluated the whole grid
+*/
+typedef struct narrow_band
+{
+  int cell_x;
+  int cell_y;
+  int band;
+  int refresh;
+  unsigned int* corner_stamp;
+  unsigned int* cell_stamp;
+  unsigned int* block_stamp;
+  int blocks_x;
+  int blocks_y;
+  unsigned int frame;
+  std::vector<int> crossing;
+  std::vector<int> work;
+  int since_refresh;
+  int evals;
+  bool full;
+} narrow_band;
+
+void narrow_band_init (narrow_band* nb);
+void narrow_band_free (narrow_band* nb);
+/**Bring grid->data up to date for the balls. Crossing cells get exact corners; the
+ * others get iso * 2 inside and 0 outside.
+ * @return number of corners evaluated
+*/
+int narrow_band_update (narrow_band* nb, field_grid* grid, const float* bx, const float* by, const float* br2, int n, float iso);
+/**Force a full evaluation on the next update
+*/
+void narrow_band_reset (narrow_band* nb);
@@ -0,0 +1,167 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "quadtree.h", "field.h", "march.h"
+*/
+
+#include "quadtree.h"
+#include "march.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**Everything a node needs, so the recursion only passes the block
+*/
+typedef struct quad_ctx
+{
+  quad_march* qm;
+  field_grid* grid;
+  const float* bx;
+  const float* by;
+  const float* br2;
+  int n;
+  float iso;
+  bool linear_interp;
+  std::vector<float>* tris;
+} quad_ctx;
+
+void quad_march_init (quad_march* qm)
+{
+  qm->stamp = NULL;
+  qm->stamp_size = 0;
+  qm->frame = 0;
+  qm->evals = 0;
+  qm->leaves = 0;
+}
+
+void quad_march_free (quad_march* qm)
+{
+  free (qm->stamp);
+  quad_march_init (qm);
+}
+
+/**Corner value, evaluated at most once per frame
+*/
+static float corner (quad_ctx* c, int i, int j)
+{
+  size_t k = (size_t)j * c->grid->stride + i;
+
+  if (c->qm->stamp[k] != c->qm->frame)
+  {
+    c->grid->data[k] = field_grid_eval_corner (c->grid, i, j, c->bx, c->by, c->br2, c->n);
+    c->qm->stamp[k] = c->qm->frame;
+    c->qm->evals++;
+  }
+  return c->grid->data[k];
+}
+
+/**true if the field is >= iso everywhere in the box (sum of r^2 over the farthest distance)
+*/
+static bool box_all_inside (quad_ctx* c, float x0, float y0, float x1, float y1)
+{
+  float lo = 0.0f;
+
+  for (int b=0; b<c->n; b++)
+  {
+    float dx = fmaxf (fabsf (c->bx[b] - x0), fabsf (c->bx[b] - x1));
+    float dy = fmaxf (fabsf (c->by[b] - y0), fabsf (c->by[b] - y1));
+    lo += c->br2[b] / (dx * dx + dy * dy);
+    if (lo >= c->iso)
+      return true;
+  }
+  return false;
+}
+
+/**true if the field is < iso everywhere in the box (sum of r^2 over the nearest distance)
+*/
+static bool box_all_outside (quad_ctx* c, float x0, float y0, float x1, float y1)
+{
+  float hi = 0.0f;
+
+  for (int b=0; b<c->n; b++)
+  {
+    float dx = fmaxf (fmaxf (x0 - c->bx[b], c->bx[b] - x1), 0.0f);
+    float dy = fmaxf (fmaxf (y0 - c->by[b], c->by[b] - y1), 0.0f);
+    float d2 = dx * dx + dy * dy;
+    if (d2 <= 0.0f)
+      return false; //ball center inside the box
+    hi += c->br2[b] / d2;
+    if (hi >= c->iso)
+      return false;
+  }
+  return true;
+}
+
+static void emit_quad (quad_ctx* c, float x0, float y0, float x1, float y1)
+{
+  //same winding as a case 0xF cell
+  float q[12] = {x0, y0, x0, y1, x1, y1,
+                 x0, y0, x1, y1, x1, y0};
+  c->tris->insert (c->tris->end(), q, q + 12);
+}
+
+static void quad_node (quad_ctx* c, int i0, int j0, int size)
+{
+  field_grid* grid = c->grid;
+  if (i0 >= grid->cell_x || j0 >= grid->cell_y)
+    return;
+  int i1 = i0 + size < grid->cell_x ? i0 + size : grid->cell_x;
+  int j1 = j0 + size < grid->cell_y ? j0 + size : grid->cell_y;
+
+  int in = (corner (c, i0, j0) >= c->iso) + (corner (c, i1, j0) >= c->iso) +
+           (corner (c, i0, j1) >= c->iso) + (corner (c, i1, j1) >= c->iso);
+  if (i1 - i0 == 1 && j1 - j0 == 1)
+  {
+    float cell[MARCH_MAX_VERTS * 2];
+    int nv = march_cell (grid, i0, j0, c->iso, c->linear_interp, cell);
+    c->tris->insert (c->tris->end(), cell, cell + nv*2);
+    c->qm->leaves++;
+    return;
+  }
+
+  float x0 = (float)i0 * grid->cell_w;
+  float y0 = (float)j0 * grid->cell_h;
+  float x1 = (float)i1 * grid->cell_w;
+  float y1 = (float)j1 * grid->cell_h;
+  if (in == 4 && box_all_inside (c, x0, y0, x1, y1))
+  {
+    emit_quad (c, x0, y0, x1, y1);
+    return;
+  }
+  if (in == 0 && box_all_outside (c, x0, y0, x1, y1))
+    return;
+
+  int h = size / 2;
+  quad_node (c, i0,     j0,     h);
+  quad_node (c, i0 + h, j0,     h);
+  quad_node (c, i0,     j0 + h, h);
+  quad_node (c, i0 + h, j0 + h, h);
+}
+
+void quad_march_grid (quad_march* qm, field_grid* grid, const float* bx, const float* by, const float* br2, int n,
+                      float iso, bool linear_interp, std::vector<float>* tris)
+{
+  size_t corners = (size_t)grid->stride * (size_t)(grid->cell_y + 1);
+  if (qm->stamp_size != corners)
+  {
+    free (qm->stamp);
+    qm->stamp = (unsigned int*) calloc (corners, sizeof(unsigned int));
+    qm->stamp_size = qm->stamp ? corners : 0;
+    qm->frame = 0;
+  }
+  tris->clear();
+  if (qm->stamp == NULL)
+    return;
+  qm->frame++;
+  if (qm->frame == 0) //wrapped around, old stamps could match again
+  {
+    memset (qm->stamp, 0, corners * sizeof(unsigned int));
+    qm->frame = 1;
+  }
+  qm->evals = 0;
+  qm->leaves = 0;
+
+  quad_ctx c = {qm, grid, bx, by, br2, n, iso, linear_interp, tris};
+  for (int j=0; j<grid->cell_y; j+=QUAD_ROOT)
+    for (int i=0; i<grid->cell_x; i+=QUAD_ROOT)
+      quad_node (&c, i, j, QUAD_ROOT);
+}
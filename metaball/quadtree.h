@@ -0,0 +1,39 @@
+/**Author: Un Hou (Albert) Chan
+ * Adaptive marching squares for large, mostly empty grids.
+ * Dependancy: "field.h", "march.h"
+ *
+ * The grid is covered by QUAD_ROOT x QUAD_ROOT cell blocks. A block is split in 4 when
+ * its corners straddle the threshold, or when its corners agree but the field bounds
+ * over the block say a blob could still poke in or out. Blocks whose corners and bounds
+ * agree are emitted as one quad (inside) or skipped (outside); single cells go through
+ * march_cell. Corners are evaluated only when a block needs them, so the cost follows
+ * the contour length instead of the grid area.
+*/
+#pragma once
+#include "field.h"
+
+#include <vector>
+
+//cells per root block side, power of 2
+#define QUAD_ROOT 32
+
+/**unsigned int* stamp; per corner, the value in grid->data is current when stamp == frame
+ * int evals, leaves; corners evaluated and cells marched in the last call
+*/
+typedef struct quad_march
+{
+  unsigned int* stamp;
+  size_t stamp_size;
+  unsigned int frame;
+  int evals;
+  int leaves;
+} quad_march;
+
+void quad_march_init (quad_march* qm);
+void quad_march_free (quad_march* qm);
+/**Triangulate the iso-region of the balls on grid. Only the corners the quadtree touches
+ * are written to grid->data, the others keep stale values.
+ * @param tris cleared, then filled with x,y pairs in GL_TRIANGLES order
+*/
+void quad_march_grid (quad_march* qm, field_grid* grid, const float* bx, const float* by, const float* br2, int n,
+                      float iso, bool linear_interp, std::vector<float>* tris);
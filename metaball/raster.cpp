@@ -0,0 +1,335 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "raster.h", "../aclib/parallel.h"
+*/
+
+#include "raster.h"
+#include "../aclib/parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+//vertices are snapped to 1/16 pixel so edge functions are exact integers
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL (1 << SUBPIXEL_BITS)
+
+/**Edge v0->v1 as E(p) = a*px + b*py + c, positive inside.
+ * Pixels exactly on the edge belong to it only on one side of a shared edge
+ * (going down, or going left when flat), so the bias moves the others out.
+*/
+typedef struct raster_edge
+{
+  long long a;
+  long long b;
+  long long c;
+} raster_edge;
+
+/**Triangle ready to fill: edges of the counter clockwise winding, and the pixels
+ * whose center is inside its bounds, clipped to the frame
+*/
+typedef struct raster_tri
+{
+  raster_edge e[3];
+  int x0, y0, x1, y1;
+} raster_tri;
+
+void frame_buffer_init (frame_buffer* fb)
+{
+  fb->width = 0;
+  fb->height = 0;
+  fb->rgba = NULL;
+}
+
+bool frame_buffer_resize (frame_buffer* fb, int width, int height)
+{
+  frame_buffer_free (fb);
+  if (width < 1 || height < 1)
+    return false;
+
+  fb->rgba = (unsigned int*) malloc ((size_t)width * (size_t)height * sizeof(unsigned int));
+  if (fb->rgba == NULL)
+    return false;
+  fb->width = width;
+  fb->height = height;
+  return true;
+}
+
+void frame_buffer_free (frame_buffer* fb)
+{
+  free (fb->rgba);
+  frame_buffer_init (fb);
+}
+
+void frame_buffer_clear (frame_buffer* fb, unsigned int color)
+{
+  size_t pixels = (size_t)fb->width * fb->height;
+  for (size_t p=0; p<pixels; p++)
+    fb->rgba[p] = color;
+}
+
+static raster_edge make_edge (const long long* v0, const long long* v1)
+{
+  raster_edge e;
+  long long dx = v1[0] - v0[0];
+  long long dy = v1[1] - v0[1];
+  e.a = -dy;
+  e.b = dx;
+  e.c = dy * v0[0] - dx * v0[1];
+  if (!(dy > 0 || (dy == 0 && dx < 0)))
+    e.c -= 1;
+  return e;
+}
+
+/**Snap, orient and bound one triangle
+ * @return false if it has no area or misses the frame
+*/
+static bool setup_tri (const frame_buffer* fb, const float* tri, raster_tri* out)
+{
+  long long v[3][2];
+  for (int k=0; k<3; k++)
+  {
+    v[k][0] = (long long)lrintf (tri[k*2+0] * SUBPIXEL);
+    v[k][1] = (long long)lrintf (tri[k*2+1] * SUBPIXEL);
+  }
+  long long area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) - (v[1][1] - v[0][1]) * (v[2][0] - v[0][0]);
+  if (area == 0)
+    return false;
+  //one winding for every triangle, so a shared edge runs opposite ways in its two triangles
+  int i1 = area > 0 ? 1 : 2;
+  int i2 = area > 0 ? 2 : 1;
+  out->e[0] = make_edge (v[0], v[i1]);
+  out->e[1] = make_edge (v[i1], v[i2]);
+  out->e[2] = make_edge (v[i2], v[0]);
+
+  long long lo_x = v[0][0], hi_x = v[0][0], lo_y = v[0][1], hi_y = v[0][1];
+  for (int k=1; k<3; k++)
+  {
+    lo_x = v[k][0] < lo_x ? v[k][0] : lo_x;
+    hi_x = v[k][0] > hi_x ? v[k][0] : hi_x;
+    lo_y = v[k][1] < lo_y ? v[k][1] : lo_y;
+    hi_y = v[k][1] > hi_y ? v[k][1] : hi_y;
+  }
+  //pixels whose center (x+0.5) is inside the bounds
+  long long x0 = (lo_x + SUBPIXEL / 2 - 1) >> SUBPIXEL_BITS;
+  long long x1 = (hi_x - SUBPIXEL / 2) >> SUBPIXEL_BITS;
+  long long y0 = (lo_y + SUBPIXEL / 2 - 1) >> SUBPIXEL_BITS;
+  long long y1 = (hi_y - SUBPIXEL / 2) >> SUBPIXEL_BITS;
+  out->x0 = (int)(x0 < 0 ? 0 : x0);
+  out->y0 = (int)(y0 < 0 ? 0 : y0);
+  out->x1 = (int)(x1 >= fb->width ? fb->width - 1 : x1);
+  out->y1 = (int)(y1 >= fb->height ? fb->height - 1 : y1);
+  return out->x0 <= out->x1 && out->y0 <= out->y1;
+}
+
+/**Fill the part of tri inside pixels [x0,x1]x[y0,y1].
+ * Edge values are exact in 64 bit at the rect corner. An edge that is positive over the
+ * whole rect drops out, one negative over it rejects the rect, and a crossing edge only
+ * spans a rect worth of values, so it steps in 32 bit lanes.
+*/
+static void fill_tri_rect (frame_buffer* fb, const raster_tri* tri, int x0, int y0, int x1, int y1, unsigned int color)
+{
+  long long px = (long long)x0 * SUBPIXEL + SUBPIXEL / 2;
+  long long py = (long long)y0 * SUBPIXEL + SUBPIXEL / 2;
+  int nx = x1 - x0 + 1;
+  int ny = y1 - y0 + 1;
+  int start[3], step_x[3], step_y[3];
+  bool solid = true;
+
+  for (int k=0; k<3; k++)
+  {
+    const raster_edge* e = &tri->e[k];
+    long long w = e->a * px + e->b * py + e->c;
+    long long dx = e->a * SUBPIXEL * (nx - 1);
+    long long dy = e->b * SUBPIXEL * (ny - 1);
+    long long lo = w + (dx < 0 ? dx : 0) + (dy < 0 ? dy : 0);
+    long long hi = w + (dx > 0 ? dx : 0) + (dy > 0 ? dy : 0);
+    if (hi < 0)
+      return;
+    if (lo >= 0)
+    {
+      start[k] = 0;
+      step_x[k] = 0;
+      step_y[k] = 0;
+      continue;
+    }
+    solid = false;
+    start[k] = (int)w;
+    step_x[k] = (int)(e->a * SUBPIXEL);
+    step_y[k] = (int)(e->b * SUBPIXEL);
+  }
+
+  for (int y=y0; y<=y1; y++)
+  {
+    unsigned int* row = fb->rgba + (size_t)y * fb->width;
+    if (solid)
+    {
+      for (int x=x0; x<=x1; x++)
+        row[x] = color;
+      continue;
+    }
+    int w0 = start[0], w1 = start[1], w2 = start[2];
+    int x = x0;
+#ifdef __SSE2__
+    __m128i v0 = _mm_add_epi32 (_mm_set1_epi32 (w0), _mm_setr_epi32 (0, step_x[0], 2 * step_x[0], 3 * step_x[0]));
+    __m128i v1 = _mm_add_epi32 (_mm_set1_epi32 (w1), _mm_setr_epi32 (0, step_x[1], 2 * step_x[1], 3 * step_x[1]));
+    __m128i v2 = _mm_add_epi32 (_mm_set1_epi32 (w2), _mm_setr_epi32 (0, step_x[2], 2 * step_x[2], 3 * step_x[2]));
+    __m128i s0 = _mm_set1_epi32 (4 * step_x[0]);
+    __m128i s1 = _mm_set1_epi32 (4 * step_x[1]);
+    __m128i s2 = _mm_set1_epi32 (4 * step_x[2]);
+    __m128i fill = _mm_set1_epi32 ((int)color);
+    __m128i minus_one = _mm_set1_epi32 (-1);
+    for (; x + 4 <= x1 + 1; x += 4)
+    {
+      //sign bit of the or is set if any edge is negative
+      __m128i inside = _mm_cmpgt_epi32 (_mm_or_si128 (_mm_or_si128 (v0, v1), v2), minus_one);
+      __m128i* dst = (__m128i*)(row + x);
+      __m128i old = _mm_loadu_si128 (dst);
+      _mm_storeu_si128 (dst, _mm_or_si128 (_mm_and_si128 (inside, fill), _mm_andnot_si128 (inside, old)));
+      v0 = _mm_add_epi32 (v0, s0);
+      v1 = _mm_add_epi32 (v1, s1);
+      v2 = _mm_add_epi32 (v2, s2);
+    }
+    w0 += (x - x0) * step_x[0];
+    w1 += (x - x0) * step_x[1];
+    w2 += (x - x0) * step_x[2];
+#endif
+    for (; x<=x1; x++)
+    {
+      if ((w0 | w1 | w2) >= 0)
+        row[x] = color;
+      w0 += step_x[0];
+      w1 += step_x[1];
+      w2 += step_x[2];
+    }
+    for (int k=0; k<3; k++)
+      start[k] += step_y[k];
+  }
+}
+
+void raster_triangles (frame_buffer* fb, const float* tris, size_t verts, unsigned int color, int threads)
+{
+  int tiles_x = (fb->width + RASTER_TILE - 1) / RASTER_TILE;
+  int tiles_y = (fb->height + RASTER_TILE - 1) / RASTER_TILE;
+  int tiles = tiles_x * tiles_y;
+  std::vector<raster_tri> list;
+  list.reserve (verts / 3);
+  for (size_t t=0; t+3<=verts; t+=3)
+  {
+    raster_tri tri;
+    if (setup_tri (fb, tris + t * 2, &tri))
+      list.push_back (tri);
+  }
+
+  //bin by counting: triangles of tile k are bin[first[k] .. first[k+1]), in input order
+  std::vector<int> first (tiles + 1, 0);
+  for (size_t t=0; t<list.size(); t++)
+    for (int ty=list[t].y0 / RASTER_TILE; ty<=list[t].y1 / RASTER_TILE; ty++)
+      for (int tx=list[t].x0 / RASTER_TILE; tx<=list[t].x1 / RASTER_TILE; tx++)
+        first[ty * tiles_x + tx + 1]++;
+  for (int k=0; k<tiles; k++)
+    first[k+1] += first[k];
+  std::vector<int> fill (first.begin(), first.end() - 1);
+  std::vector<int> bin (first[tiles]);
+  for (size_t t=0; t<list.size(); t++)
+    for (int ty=list[t].y0 / RASTER_TILE; ty<=list[t].y1 / RASTER_TILE; ty++)
+      for (int tx=list[t].x0 / RASTER_TILE; tx<=list[t].x1 / RASTER_TILE; tx++)
+        bin[fill[ty * tiles_x + tx]++] = (int)t;
+
+  aclib::parallel_for (tiles, threads, [&](int k){
+    int tx0 = (k % tiles_x) * RASTER_TILE;
+    int ty0 = (k / tiles_x) * RASTER_TILE;
+    int tx1 = tx0 + RASTER_TILE - 1 < fb->width ? tx0 + RASTER_TILE - 1 : fb->width - 1;
+    int ty1 = ty0 + RASTER_TILE - 1 < fb->height ? ty0 + RASTER_TILE - 1 : fb->height - 1;
+    for (int i=first[k]; i<first[k+1]; i++)
+    {
+      const raster_tri* tri = &list[bin[i]];
+      fill_tri_rect (fb, tri, tri->x0 > tx0 ? tri->x0 : tx0, tri->y0 > ty0 ? tri->y0 : ty0,
+                     tri->x1 < tx1 ? tri->x1 : tx1, tri->y1 < ty1 ? tri->y1 : ty1, color);
+    }
+  });
+}
+
+void raster_field (frame_buffer* fb, const float* bx, const float* by, const float* br2, int n,
+                   float iso, unsigned int color, int threads)
+{
+  int tiles_x = (fb->width + RASTER_TILE - 1) / RASTER_TILE;
+  int tiles_y = (fb->height + RASTER_TILE - 1) / RASTER_TILE;
+
+  aclib::parallel_for (tiles_x * tiles_y, threads, [&](int k){
+    int tx0 = (k % tiles_x) * RASTER_TILE;
+    int ty0 = (k / tiles_x) * RASTER_TILE;
+    int tx1 = tx0 + RASTER_TILE < fb->width ? tx0 + RASTER_TILE : fb->width;
+    int ty1 = ty0 + RASTER_TILE < fb->height ? ty0 + RASTER_TILE : fb->height;
+    std::vector<float> dy2 (n);
+    for (int y=ty0; y<ty1; y++)
+    {
+      unsigned int* row = fb->rgba + (size_t)y * fb->width;
+      float py = (float)y + 0.5f;
+      for (int b=0; b<n; b++)
+        dy2[b] = (py - by[b]) * (py - by[b]);
+      int x = tx0;
+#ifdef __SSE2__
+      __m128i fill = _mm_set1_epi32 ((int)color);
+      for (; x + 4 <= tx1; x += 4)
+      {
+        __m128 px = _mm_add_ps (_mm_set1_ps ((float)x + 0.5f), _mm_setr_ps (0.0f, 1.0f, 2.0f, 3.0f));
+        __m128 sum = _mm_setzero_ps();
+        for (int b=0; b<n; b++)
+        {
+          __m128 dx = _mm_sub_ps (px, _mm_set1_ps (bx[b]));
+          __m128 d2 = _mm_add_ps (_mm_mul_ps (dx, dx), _mm_set1_ps (dy2[b]));
+          sum = _mm_add_ps (sum, _mm_div_ps (_mm_set1_ps (br2[b]), d2));
+        }
+        __m128i inside = _mm_castps_si128 (_mm_cmpge_ps (sum, _mm_set1_ps (iso)));
+        __m128i* dst = (__m128i*)(row + x);
+        __m128i old = _mm_loadu_si128 (dst);
+        _mm_storeu_si128 (dst, _mm_or_si128 (_mm_and_si128 (inside, fill), _mm_andnot_si128 (inside, old)));
+      }
+#endif
+      for (; x<tx1; x++)
+      {
+        float px = (float)x + 0.5f;
+        float sum = 0.0f;
+        for (int b=0; b<n; b++)
+          sum += br2[b] / ((px - bx[b]) * (px - bx[b]) + dy2[b]);
+        if (sum >= iso)
+          row[x] = color;
+      }
+    }
+  });
+}
+
+bool frame_write_ppm (const frame_buffer* fb, const char* path)
+{
+  FILE* file = fopen (path, "wb");
+  if (file == NULL)
+    return false;
+  std::vector<unsigned char> line ((size_t)fb->width * 3);
+  bool ok = fprintf (file, "P6\n%d %d\n255\n", fb->width, fb->height) > 0;
+  for (int y=0; y<fb->height && ok; y++)
+  {
+    const unsigned char* src = (const unsigned char*)(fb->rgba + (size_t)y * fb->width);
+    for (int x=0; x<fb->width; x++)
+    {
+      line[x*3+0] = src[x*4+0];
+      line[x*3+1] = src[x*4+1];
+      line[x*3+2] = src[x*4+2];
+    }
+    ok = fwrite (&line[0], 1, line.size(), file) == line.size();
+  }
+  return fclose (file) == 0 && ok;
+}
+
+bool frame_write_raw (const frame_buffer* fb, const char* path)
+{
+  FILE* file = fopen (path, "wb");
+  if (file == NULL)
+    return false;
+  size_t pixels = (size_t)fb->width * fb->height;
+  bool ok = fwrite (fb->rgba, sizeof(unsigned int), pixels, file) == pixels;
+  return fclose (file) == 0 && ok;
+}
@@ -0,0 +1,70 @@
+/**Author: Un Hou (Albert) Chan
+ * CPU rasterizer for the metaballs, no OpenGL needed.
+ * Dependancy: "../aclib/parallel.h"
+ *
+ * The frame is cut into RASTER_TILE x RASTER_TILE tiles, triangles are binned to the
+ * tiles their bounds touch, and tiles are filled in parallel. Pixel centers are tested
+ * against the three edge functions 4 at a time (SSE2 when available), with a top-left
+ * rule so two triangles sharing an edge never both fill (or both miss) a pixel on it.
+ * Vertices are snapped to 1/16 pixel, so the tests are exact integers.
+ *
+ * raster_field skips the triangles and thresholds the field at every pixel center
+ * instead: more work per pixel, but no marching squares and exact curves.
+ *
+ * World unit is one pixel, y points down like the GLUT window.
+*/
+#pragma once
+
+#include <stddef.h>
+
+//pixels per tile side
+#define RASTER_TILE 64
+
+/**int width, height; in pixel
+ * unsigned int* rgba; width*height pixels, row-major from the top, see raster_rgba
+*/
+typedef struct frame_buffer
+{
+  int width;
+  int height;
+  unsigned int* rgba;
+} frame_buffer;
+
+/**Pixel value with bytes R,G,B,A in memory order (little endian)
+*/
+inline unsigned int raster_rgba (unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+  return (unsigned int)r | ((unsigned int)g << 8) | ((unsigned int)b << 16) | ((unsigned int)a << 24);
+}
+/**Initialize an empty buffer. Must be called before frame_buffer_resize
+*/
+void frame_buffer_init (frame_buffer* fb);
+/**(Re)allocate for a new size. Old pixels are discarded.
+ * @return false if allocation failed or the size is invalid; the buffer is left empty
+*/
+bool frame_buffer_resize (frame_buffer* fb, int width, int height);
+void frame_buffer_free (frame_buffer* fb);
+/**Fill the whole buffer with one color
+*/
+void frame_buffer_clear (frame_buffer* fb, unsigned int color);
+/**Fill triangles with one color
+ * @param tris x,y pairs, 3 vertices per triangle, either winding
+ * @param verts number of vertices (not floats)
+ * @param threads tiles are shared among this many threads, <= 0 for one per hardware thread
+*/
+void raster_triangles (frame_buffer* fb, const float* tris, size_t verts, unsigned int color, int threads);
+/**Fill every pixel whose center has sum(r^2/d^2) >= iso
+ * @param bx, by ball centers
+ * @param br2 ball radius squared
+ * @param threads as raster_triangles
+*/
+void raster_field (frame_buffer* fb, const float* bx, const float* by, const float* br2, int n,
+                   float iso, unsigned int color, int threads);
+/**Write the buffer as a binary PPM (P6), alpha dropped
+ * @return false if the file cannot be written
+*/
+bool frame_write_ppm (const frame_buffer* fb, const char* path);
+/**Write the bare pixels, no header: width*height*4 bytes RGBA
+ * @return false if the file cannot be written
+*/
+bool frame_write_raw (const frame_buffer* fb, const char* path);
@@ -0,0 +1,340 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "collide.h", "particle.h", "../aclib/parallel.h"
+*/
+
+#include "collide.h"
+#include "../aclib/parallel.h"
+
+#include <math.h>
+#include <algorithm>
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+//particles per thread task
+#define COLLIDE_TASK 4096
+//most grid cells per live particle; past it the cells grow
+#define COLLIDE_CELLS_PER_PARTICLE 2
+
+void particle_grid_init (particle_grid* grid)
+{
+  grid->cell_x = grid->cell_y = grid->cell_z = 0;
+  grid->cell = 0.0f;
+  grid->ox = grid->oy = grid->oz = 0.0f;
+  grid->cell_of.clear();
+  grid->first.clear();
+  grid->order.clear();
+  particle_set_init (&grid->sorted);
+  grid->contacts = 0;
+}
+
+void particle_grid_free (particle_grid* grid)
+{
+  particle_set_free (&grid->sorted);
+  std::vector<int>().swap (grid->cell_of);
+  std::vector<int>().swap (grid->first);
+  std::vector<int>().swap (grid->order);
+  particle_grid_init (grid);
+}
+
+/**Cell along one axis, clamped to the grid
+*/
+static inline int cell_coord (float p, float origin, float inv_cell, int cells)
+{
+  int c = (int)((p - origin) * inv_cell);
+  return c < 0 ? 0 : (c >= cells ? cells - 1 : c);
+}
+
+/**Zero [from, to) of the arrays of set
+*/
+static void zero_slots (particle_set* set, int from, int to)
+{
+  for (int i=from; i<to; i++)
+  {
+    set->x[i] = set->y[i] = set->z[i] = 0.0f;
+    set->vx[i] = set->vy[i] = set->vz[i] = 0.0f;
+    set->color[i] = set->fade[i] = 0.0f;
+  }
+}
+
+/**Grid over the bounding box of the live particles
+ * @return false if the box is not finite
+*/
+static bool fit_grid (const particle_set* set, particle_grid* grid, float radius, int tasks, int threads)
+{
+  int n = set->count;
+  std::vector<float> box (tasks * 6);
+
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int first = t * COLLIDE_TASK;
+    int last = first + COLLIDE_TASK < n ? first + COLLIDE_TASK : n;
+    float* b = &box[t * 6];
+    b[0] = b[3] = set->x[first];
+    b[1] = b[4] = set->y[first];
+    b[2] = b[5] = set->z[first];
+    for (int i=first+1; i<last; i++)
+    {
+      b[0] = std::min (b[0], set->x[i]);
+      b[1] = std::min (b[1], set->y[i]);
+      b[2] = std::min (b[2], set->z[i]);
+      b[3] = std::max (b[3], set->x[i]);
+      b[4] = std::max (b[4], set->y[i]);
+      b[5] = std::max (b[5], set->z[i]);
+    }
+  });
+  for (int t=1; t<tasks; t++)
+    for (int a=0; a<3; a++)
+    {
+      box[a] = std::min (box[a], box[t * 6 + a]);
+      box[a + 3] = std::max (box[a + 3], box[t * 6 + a + 3]);
+    }
+  for (int a=0; a<6; a++)
+    if (!isfinite (box[a]))
+      return false;
+
+  //cells of 2 * radius, grown while the box would need too many
+  double limit = (double)n * COLLIDE_CELLS_PER_PARTICLE + 27.0;
+  float cell = 2.0f * radius;
+  for (;;)
+  {
+    grid->cell_x = (int)std::min ((box[3] - box[0]) / cell + 1.0f, 1e9f);
+    grid->cell_y = (int)std::min ((box[4] - box[1]) / cell + 1.0f, 1e9f);
+    grid->cell_z = (int)std::min ((box[5] - box[2]) / cell + 1.0f, 1e9f);
+    if ((double)grid->cell_x * grid->cell_y * grid->cell_z <= limit)
+      break;
+    cell *= 1.25f;
+  }
+  grid->cell = cell;
+  grid->ox = box[0];
+  grid->oy = box[1];
+  grid->oz = box[2];
+  return true;
+}
+
+/**Counting sort of the live particles by cell: cell of every particle, count per cell,
+ * prefix sum, slot of every particle, then every attribute gathered into grid->sorted,
+ * whose arrays are swapped with the ones of set
+*/
+static void sort_by_cell (particle_set* set, particle_grid* grid, int tasks, int threads)
+{
+  int n = set->count;
+  int cells = grid->cell_x * grid->cell_y * grid->cell_z;
+  float inv = 1.0f / grid->cell;
+
+  grid->cell_of.resize (n);
+  grid->order.resize (n);
+  grid->first.assign (cells + 1, 0);
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int last = (t + 1) * COLLIDE_TASK < n ? (t + 1) * COLLIDE_TASK : n;
+    for (int i=t*COLLIDE_TASK; i<last; i++)
+    {
+      int cx = cell_coord (set->x[i], grid->ox, inv, grid->cell_x);
+      int cy = cell_coord (set->y[i], grid->oy, inv, grid->cell_y);
+      int cz = cell_coord (set->z[i], grid->oz, inv, grid->cell_z);
+      grid->cell_of[i] = (cz * grid->cell_y + cy) * grid->cell_x + cx;
+    }
+  });
+
+  //one int per particle and per cell, cheap next to the gather of 8 floats
+  int* first = grid->first.data();
+  for (int i=0; i<n; i++)
+    first[grid->cell_of[i] + 1]++;
+  for (int c=0; c<cells; c++)
+    first[c + 1] += first[c];
+  //first[c] walks to the end of cell c, which is the start of c + 1; shift it back after
+  for (int i=0; i<n; i++)
+    grid->order[first[grid->cell_of[i]]++] = i;
+  for (int c=cells; c>0; c--)
+    first[c] = first[c - 1];
+  first[0] = 0;
+
+  particle_set* dst = &grid->sorted;
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int last = (t + 1) * COLLIDE_TASK < n ? (t + 1) * COLLIDE_TASK : n;
+    for (int k=t*COLLIDE_TASK; k<last; k++)
+    {
+      int i = grid->order[k];
+      dst->x[k] = set->x[i];
+      dst->y[k] = set->y[i];
+      dst->z[k] = set->z[i];
+      dst->vx[k] = set->vx[i];
+      dst->vy[k] = set->vy[i];
+      dst->vz[k] = set->vz[i];
+      dst->color[k] = set->color[i];
+      dst->fade[k] = set->fade[i];
+    }
+  });
+  zero_slots (dst, n, (n + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES);
+  std::swap (set->x, dst->x);
+  std::swap (set->y, dst->y);
+  std::swap (set->z, dst->z);
+  std::swap (set->vx, dst->vx);
+  std::swap (set->vy, dst->vy);
+  std::swap (set->vz, dst->vz);
+  std::swap (set->color, dst->color);
+  std::swap (set->fade, dst->fade);
+  set->layout++;
+}
+
+#if defined(__AVX2__)
+static inline float sum_lanes (__m256 v)
+{
+  __m128 s = _mm_add_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1));
+  s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+  s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+  return _mm_cvtss_f32 (s);
+}
+#elif defined(__SSE2__)
+static inline float sum_lanes (__m128 s)
+{
+  s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+  s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+  return _mm_cvtss_f32 (s);
+}
+#endif
+
+/**Narrow phase of particle i against the contiguous slots [s, e): for every j closer than
+ * reach (but not at the same point) and approaching, adds (u . d) / |d|^2 * d to dv, with
+ * d = x_j - x_i and u = v_j - v_i
+ * @return contacts found
+*/
+static int narrow_range (const particle_set* set, int i, int s, int e, float reach2, float* dv)
+{
+  float xi = set->x[i], yi = set->y[i], zi = set->z[i];
+  float vxi = set->vx[i], vyi = set->vy[i], vzi = set->vz[i];
+  int contacts = 0;
+  int j = s;
+
+#if defined(__AVX2__)
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 r2 = _mm256_set1_ps (reach2);
+  const __m256i lane = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i end = _mm256_set1_epi32 (e);
+  __m256 ax = zero, ay = zero, az = zero;
+  //runs are short (a few particles per cell), so the last vector is masked rather than
+  //left to the scalar loop; it may read past e but not past the arrays
+  for (; j<e && j+8<=set->capacity; j+=8)
+  {
+    __m256 dx = _mm256_sub_ps (_mm256_loadu_ps (set->x + j), _mm256_set1_ps (xi));
+    __m256 dy = _mm256_sub_ps (_mm256_loadu_ps (set->y + j), _mm256_set1_ps (yi));
+    __m256 dz = _mm256_sub_ps (_mm256_loadu_ps (set->z + j), _mm256_set1_ps (zi));
+    __m256 d2 = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (dx, dx), _mm256_mul_ps (dy, dy)), _mm256_mul_ps (dz, dz));
+    __m256 un = _mm256_add_ps (_mm256_add_ps (
+                  _mm256_mul_ps (_mm256_sub_ps (_mm256_loadu_ps (set->vx + j), _mm256_set1_ps (vxi)), dx),
+                  _mm256_mul_ps (_mm256_sub_ps (_mm256_loadu_ps (set->vy + j), _mm256_set1_ps (vyi)), dy)),
+                  _mm256_mul_ps (_mm256_sub_ps (_mm256_loadu_ps (set->vz + j), _mm256_set1_ps (vzi)), dz));
+    __m256 in = _mm256_castsi256_ps (_mm256_cmpgt_epi32 (end, _mm256_add_epi32 (_mm256_set1_epi32 (j), lane)));
+    __m256 hit = _mm256_and_ps (_mm256_and_ps (_mm256_cmp_ps (d2, r2, _CMP_LT_OQ), _mm256_cmp_ps (d2, zero, _CMP_GT_OQ)),
+                                _mm256_and_ps (_mm256_cmp_ps (un, zero, _CMP_LT_OQ), in));
+    contacts += __builtin_popcount (_mm256_movemask_ps (hit));
+    //masked lanes may divide by 0; the and drops them
+    __m256 k = _mm256_and_ps (hit, _mm256_div_ps (un, d2));
+    ax = _mm256_add_ps (ax, _mm256_mul_ps (k, dx));
+    ay = _mm256_add_ps (ay, _mm256_mul_ps (k, dy));
+    az = _mm256_add_ps (az, _mm256_mul_ps (k, dz));
+  }
+  dv[0] += sum_lanes (ax);
+  dv[1] += sum_lanes (ay);
+  dv[2] += sum_lanes (az);
+#elif defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 r2 = _mm_set1_ps (reach2);
+  const __m128i lane = _mm_setr_epi32 (0, 1, 2, 3);
+  const __m128i end = _mm_set1_epi32 (e);
+  __m128 ax = zero, ay = zero, az = zero;
+  for (; j<e && j+4<=set->capacity; j+=4)
+  {
+    __m128 dx = _mm_sub_ps (_mm_loadu_ps (set->x + j), _mm_set1_ps (xi));
+    __m128 dy = _mm_sub_ps (_mm_loadu_ps (set->y + j), _mm_set1_ps (yi));
+    __m128 dz = _mm_sub_ps (_mm_loadu_ps (set->z + j), _mm_set1_ps (zi));
+    __m128 d2 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz));
+    __m128 un = _mm_add_ps (_mm_add_ps (
+                  _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (set->vx + j), _mm_set1_ps (vxi)), dx),
+                  _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (set->vy + j), _mm_set1_ps (vyi)), dy)),
+                  _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (set->vz + j), _mm_set1_ps (vzi)), dz));
+    __m128 in = _mm_castsi128_ps (_mm_cmpgt_epi32 (end, _mm_add_epi32 (_mm_set1_epi32 (j), lane)));
+    __m128 hit = _mm_and_ps (_mm_and_ps (_mm_cmplt_ps (d2, r2), _mm_cmpgt_ps (d2, zero)),
+                             _mm_and_ps (_mm_cmplt_ps (un, zero), in));
+    contacts += __builtin_popcount (_mm_movemask_ps (hit));
+    __m128 k = _mm_and_ps (hit, _mm_div_ps (un, d2));
+    ax = _mm_add_ps (ax, _mm_mul_ps (k, dx));
+    ay = _mm_add_ps (ay, _mm_mul_ps (k, dy));
+    az = _mm_add_ps (az, _mm_mul_ps (k, dz));
+  }
+  dv[0] += sum_lanes (ax);
+  dv[1] += sum_lanes (ay);
+  dv[2] += sum_lanes (az);
+#endif
+  for (; j<e; j++)
+  {
+    float dx = set->x[j] - xi, dy = set->y[j] - yi, dz = set->z[j] - zi;
+    float d2 = (dx * dx + dy * dy) + dz * dz;
+    float un = ((set->vx[j] - vxi) * dx + (set->vy[j] - vyi) * dy) + (set->vz[j] - vzi) * dz;
+    if (!(d2 < reach2 && d2 > 0.0f && un < 0.0f))
+      continue;
+    contacts++;
+    float k = un / d2;
+    dv[0] += k * dx;
+    dv[1] += k * dy;
+    dv[2] += k * dz;
+  }
+  return contacts;
+}
+
+bool particle_collide (particle_set* set, particle_grid* grid, float radius, float restitution, int threads)
+{
+  int n = set->count;
+  grid->contacts = 0;
+  if (n < 2 || radius <= 0.0f)
+    return true;
+  if (grid->sorted.size != set->size && !particle_set_resize (&grid->sorted, set->size))
+    return false;
+  int tasks = (n + COLLIDE_TASK - 1) / COLLIDE_TASK;
+  if (!fit_grid (set, grid, radius, tasks, threads))
+    return true;
+  sort_by_cell (set, grid, tasks, threads);
+
+  //new velocities go to the scratch arrays, the old ones stay readable for every particle
+  const int* first = grid->first.data();
+  float inv = 1.0f / grid->cell;
+  float reach2 = 4.0f * radius * radius;
+  float share = 0.5f * (1.0f + restitution);
+  particle_set* out = &grid->sorted;
+  std::vector<int> contacts (tasks, 0);
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int last = (t + 1) * COLLIDE_TASK < n ? (t + 1) * COLLIDE_TASK : n;
+    for (int i=t*COLLIDE_TASK; i<last; i++)
+    {
+      int cx = cell_coord (set->x[i], grid->ox, inv, grid->cell_x);
+      int cy = cell_coord (set->y[i], grid->oy, inv, grid->cell_y);
+      int cz = cell_coord (set->z[i], grid->oz, inv, grid->cell_z);
+      int x0 = cx > 0 ? cx - 1 : 0;
+      int x1 = cx + 1 < grid->cell_x ? cx + 1 : cx;
+      float dv[3] = {0.0f, 0.0f, 0.0f};
+      //the 3 cells of a row are one run of slots
+      for (int z=std::max (cz - 1, 0); z<=std::min (cz + 1, grid->cell_z - 1); z++)
+        for (int y=std::max (cy - 1, 0); y<=std::min (cy + 1, grid->cell_y - 1); y++)
+        {
+          int row = (z * grid->cell_y + y) * grid->cell_x;
+          contacts[t] += narrow_range (set, i, first[row + x0], first[row + x1 + 1], reach2, dv);
+        }
+      out->vx[i] = set->vx[i] + share * dv[0];
+      out->vy[i] = set->vy[i] + share * dv[1];
+      out->vz[i] = set->vz[i] + share * dv[2];
+    }
+  });
+  for (int i=n; i<(n + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES; i++)
+    out->vx[i] = out->vy[i] = out->vz[i] = 0.0f;
+  std::swap (set->vx, out->vx);
+  std::swap (set->vy, out->vy);
+  std::swap (set->vz, out->vz);
+  for (int t=0; t<tasks; t++)
+    grid->contacts += contacts[t];
+  return true;
+}
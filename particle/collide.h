@@ -0,0 +1,55 @@
+/**Author: Un Hou (Albert) Chan
+ * Particle-particle collisions of project 2 on a uniform grid.
+ * Dependancy: "particle.h", "../aclib/parallel.h"
+ *
+ * Every step the live particles are binned into cubic cells of side 2 * radius over their
+ * bounding box by a counting sort: cell index per particle, a count per cell, a prefix sum
+ * for the first slot of each cell, then every attribute gathered into cell order. Sorting
+ * the particle arrays themselves (not an index list) makes the particles of a cell, and of
+ * the 3 cells of a grid row, contiguous: the narrow phase reads them as plain SIMD vectors,
+ * and the next step and the drawing walk memory in spatial order too.
+ *
+ * Each particle then sums the impulses of every approaching neighbour within 2 * radius from
+ * the 27 cells around it, against the velocities of before the pass (equal masses, impulse
+ * along the line of centres), and writes only its own new velocity, so the particles can be
+ * split between threads without locks and every pair is seen from both sides.
+*/
+#pragma once
+#include "particle.h"
+
+#include <vector>
+
+/**int cell_x, cell_y, cell_z; grid shape of the last pass
+ * float cell; cell side of the last pass, grown past 2 * radius when the box would need too many cells
+ * float ox, oy, oz; corner of the grid
+ * std::vector<int> cell_of; cell of every particle, before the sort
+ * std::vector<int> first; first slot of every cell, and the count as the last entry
+ * std::vector<int> order; particle of every slot
+ * particle_set sorted; scratch arrays the particles are gathered into
+ * int contacts; approaching pairs within reach found by the last pass, each counted twice
+*/
+typedef struct particle_grid
+{
+  int cell_x;
+  int cell_y;
+  int cell_z;
+  float cell;
+  float ox, oy, oz;
+  std::vector<int> cell_of;
+  std::vector<int> first;
+  std::vector<int> order;
+  particle_set sorted;
+  int contacts;
+} particle_grid;
+
+/**Initialize an empty grid
+*/
+void particle_grid_init (particle_grid* grid);
+void particle_grid_free (particle_grid* grid);
+/**Sort the live particles of set by cell and bounce every approaching pair closer than
+ * 2 * radius. Positions are not changed, only velocities and the particle order.
+ * @param restitution 1 for elastic bounces, 0 to only stop the approach
+ * @param threads <= 0 means one per hardware thread
+ * @return false if out of memory, set is then untouched
+*/
+bool particle_collide (particle_set* set, particle_grid* grid, float radius, float restitution, int threads);
@@ -0,0 +1,184 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "depth_sort.h", "particle.h", "../aclib/parallel.h"
+*/
+
+#include "depth_sort.h"
+#include "../aclib/parallel.h"
+
+#include <string.h>
+
+//keys per thread task; the 256 counters of a task stay in L1 while it walks them
+#define RADIX_TASK 65536
+#define RADIX_BITS 8
+#define RADIX_DIGITS (1 << RADIX_BITS)
+
+void particle_depth_init (particle_depth_order* order)
+{
+  order->index.clear();
+  order->keys.clear();
+  order->keys_tmp.clear();
+  order->index_tmp.clear();
+  order->hist.clear();
+  order->age = 0;
+  order->layout = 0;
+}
+
+void particle_depth_free (particle_depth_order* order)
+{
+  std::vector<int>().swap (order->index);
+  std::vector<unsigned int>().swap (order->keys);
+  std::vector<unsigned int>().swap (order->keys_tmp);
+  std::vector<int>().swap (order->index_tmp);
+  std::vector<int>().swap (order->hist);
+  order->age = 0;
+}
+
+/**Unsigned key in the order of the float: positives get the sign bit, negatives are inverted
+*/
+static inline unsigned int float_key (float f)
+{
+  unsigned int u;
+  memcpy (&u, &f, sizeof(u));
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+/**Keep the last order for the live count: drop slots that died, append the new ones
+*/
+static void fit_order (particle_depth_order* order, int count)
+{
+  int kept = 0;
+  int old = (int)order->index.size();
+  for (int k=0; k<old; k++)
+    if (order->index[k] < count)
+      order->index[kept++] = order->index[k];
+  order->index.resize (count);
+  for (int i=old; i<count; i++)
+    order->index[kept++] = i;
+}
+
+void particle_depth_sort (particle_depth_order* order, const particle_set* set, const float* axis, int every, int threads)
+{
+  int n = set->count;
+  if (order->age > 0 && order->age < every && order->layout == set->layout)
+  {
+    if ((int)order->index.size() != n)
+      fit_order (order, n);
+    order->age++;
+    return;
+  }
+
+  order->index.resize (n);
+  order->keys.resize (n);
+  order->index_tmp.resize (n);
+  order->keys_tmp.resize (n);
+  order->age = 1;
+  order->layout = set->layout;
+  if (n == 0)
+    return;
+  int tasks = (n + RADIX_TASK - 1) / RADIX_TASK;
+  order->hist.resize ((size_t)tasks * RADIX_DIGITS);
+
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int last = (t + 1) * RADIX_TASK < n ? (t + 1) * RADIX_TASK : n;
+    for (int i=t*RADIX_TASK; i<last; i++)
+    {
+      order->keys[i] = float_key (axis[0] * set->x[i] + axis[1] * set->y[i] + axis[2] * set->z[i]);
+      order->index[i] = i;
+    }
+  });
+
+  for (int shift=0; shift<32; shift+=RADIX_BITS)
+  {
+    const unsigned int* keys = order->keys.data();
+    int* hist = order->hist.data();
+    aclib::parallel_for (tasks, threads, [&](int t)
+    {
+      int* h = hist + t * RADIX_DIGITS;
+      int last = (t + 1) * RADIX_TASK < n ? (t + 1) * RADIX_TASK : n;
+      memset (h, 0, RADIX_DIGITS * sizeof(int));
+      for (int i=t*RADIX_TASK; i<last; i++)
+        h[(keys[i] >> shift) & (RADIX_DIGITS - 1)]++;
+    });
+
+    //one digit for every key: nothing moves
+    int d0 = (keys[0] >> shift) & (RADIX_DIGITS - 1);
+    int same = 0;
+    for (int t=0; t<tasks; t++)
+      same += hist[t * RADIX_DIGITS + d0];
+    if (same == n)
+      continue;
+
+    //slots: digit major, then task order, so the scatter is stable
+    int slot = 0;
+    for (int d=0; d<RADIX_DIGITS; d++)
+      for (int t=0; t<tasks; t++)
+      {
+        int c = hist[t * RADIX_DIGITS + d];
+        hist[t * RADIX_DIGITS + d] = slot;
+        slot += c;
+      }
+
+    const int* index = order->index.data();
+    unsigned int* keys_out = order->keys_tmp.data();
+    int* index_out = order->index_tmp.data();
+    aclib::parallel_for (tasks, threads, [&](int t)
+    {
+      int* h = hist + t * RADIX_DIGITS;
+      int last = (t + 1) * RADIX_TASK < n ? (t + 1) * RADIX_TASK : n;
+      for (int i=t*RADIX_TASK; i<last; i++)
+      {
+        int s = h[(keys[i] >> shift) & (RADIX_DIGITS - 1)]++;
+        keys_out[s] = keys[i];
+        index_out[s] = index[i];
+      }
+    });
+    order->keys.swap (order->keys_tmp);
+    order->index.swap (order->index_tmp);
+  }
+}
+
+/**Vertices of order->index[first, last), from out on
+*/
+static void pack_range (const particle_depth_order* order, const particle_set* set, int first, int last, bool triangles,
+                        float size, particle_vertex* out)
+{
+  for (int k=first; k<last; k++)
+  {
+    int i = order->index[k];
+    float c = set->color[i];
+    particle_vertex v;
+    v.r = v.g = 0xff;
+    v.b = 0;
+    v.a = (unsigned char)(c * 255.0f + 0.5f);
+    v.x = set->x[i];
+    v.y = set->y[i];
+    v.z = set->z[i];
+    if (!triangles)
+    {
+      *out++ = v;
+      continue;
+    }
+    out[0] = out[1] = out[2] = v;
+    out[0].x += size;
+    out[1].x += size;
+    out[1].y += size;
+    out[2].y += size;
+    out += 3;
+  }
+}
+
+int particle_depth_pack (const particle_depth_order* order, const particle_set* set, bool triangles, float size,
+                         particle_vertex* out, int threads)
+{
+  int n = (int)order->index.size() < set->count ? (int)order->index.size() : set->count;
+  int per = triangles ? 3 : 1;
+  int tasks = (n + RADIX_TASK - 1) / RADIX_TASK;
+
+  aclib::parallel_for (tasks, threads, [&](int t)
+  {
+    int last = (t + 1) * RADIX_TASK < n ? (t + 1) * RADIX_TASK : n;
+    pack_range (order, set, t * RADIX_TASK, last, triangles, size, out + (size_t)t * RADIX_TASK * per);
+  });
+  return n * per;
+}
@@ -0,0 +1,55 @@
+/**Author: Un Hou (Albert) Chan
+ * Back to front order of the particles for alpha blending.
+ * Dependancy: "particle.h", "../aclib/parallel.h"
+ *
+ * The view depth of every live particle is turned into an unsigned key that sorts like the
+ * float (sign bit flipped, negatives inverted), then the (key, index) pairs are sorted by a
+ * least significant digit radix sort: 4 passes of 8 bits, each one a histogram per thread
+ * task, a prefix sum over (digit, task) and a stable scatter by every task into its own
+ * slots. Passes whose digit is the same for every key are skipped, which is common for the
+ * high bits of depths in a small range. The cost is linear in the particles, 16 bytes moved
+ * per particle per pass.
+ *
+ * Depth changes little from one frame to the next, so the order can be kept for a few
+ * frames: particles born since are appended (drawn last), slots past the live count dropped.
+ * It is only kept while the particles stay in their slots; once the set's layout changes
+ * (swap-remove of the dead, the cell sort of collisions) the next call sorts in full.
+*/
+#pragma once
+#include "particle.h"
+
+#include <vector>
+
+/**std::vector<int> index; particles back to front
+ * std::vector<unsigned int> keys; sort keys of index
+ * std::vector<unsigned int> keys_tmp; std::vector<int> index_tmp; scatter targets of a pass
+ * std::vector<int> hist; digit counts, then slots, of every task
+ * int age; frames the order has been used, 0 for none yet
+ * unsigned int layout; layout of the set the order was made for
+*/
+typedef struct particle_depth_order
+{
+  std::vector<int> index;
+  std::vector<unsigned int> keys;
+  std::vector<unsigned int> keys_tmp;
+  std::vector<int> index_tmp;
+  std::vector<int> hist;
+  int age;
+  unsigned int layout;
+} particle_depth_order;
+
+void particle_depth_init (particle_depth_order* order);
+void particle_depth_free (particle_depth_order* order);
+/**Order the live particles of set back to front, depth being axis[0] * x + axis[1] * y +
+ * axis[2] * z (the eye space z: row 2 of the modelview, so the most negative is farthest).
+ * @param every sort only every that many calls (1 for always); in between the last order is
+ *   kept, fitted to the live count, unless the particles changed slots since
+ * @param threads <= 0 means one per hardware thread
+*/
+void particle_depth_sort (particle_depth_order* order, const particle_set* set, const float* axis, int every, int threads);
+/**Write the vertices of the particles in order->index to out, like particle_set_pack, but
+ * for blending: full yellow with the particle's color as alpha
+ * @return number of vertices written
+*/
+int particle_depth_pack (const particle_depth_order* order, const particle_set* set, bool triangles, float size,
+                         particle_vertex* out, int threads);
@@ -0,0 +1,690 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "particle.h", "../aclib/parallel.h"
+*/
+
+#include "particle.h"
+#include "../aclib/parallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+//alignment of every array, one AVX register
+#define PARTICLE_ALIGN 32
+//bytes a step touches per particle: 8 floats read, 8 written
+#define STEP_BYTES (16 * sizeof(float))
+
+/**Particles per thread task: half the L2 cache of working set, so the reads and writes of
+ * a task stay in its core's own cache, and there are enough tasks to balance the threads
+*/
+static int compute_chunk ()
+{
+  int c = (int)(aclib::l2_cache_bytes() / 2 / STEP_BYTES) / PARTICLE_LANES * PARTICLE_LANES;
+  return c > PARTICLE_LANES * 64 ? c : PARTICLE_LANES * 64;
+}
+
+static int chunk_size ()
+{
+  static const int chunk = compute_chunk();
+  return chunk;
+}
+
+static inline int padded (int n)
+{
+  return (n + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+}
+
+static void* aligned_block (int n, size_t item)
+{
+  void* p = NULL;
+  if (posix_memalign (&p, PARTICLE_ALIGN, (size_t)n * item) != 0)
+    return NULL;
+  memset (p, 0, (size_t)n * item);
+  return p;
+}
+
+static float* aligned_floats (int n)
+{
+  return (float*) aligned_block (n, sizeof(float));
+}
+
+/**Zero the slots from count to the next multiple of PARTICLE_LANES, so the step's last
+ * vector never sees a stale particle
+*/
+static void clear_tail (particle_set* set)
+{
+  for (int i=set->count; i<padded (set->count); i++)
+  {
+    set->x[i] = set->y[i] = set->z[i] = 0.0f;
+    set->vx[i] = set->vy[i] = set->vz[i] = 0.0f;
+    set->color[i] = set->fade[i] = 0.0f;
+  }
+}
+
+void particle_set_init (particle_set* set)
+{
+  set->count = 0;
+  set->size = 0;
+  set->capacity = 0;
+  set->x = NULL;
+  set->y = NULL;
+  set->z = NULL;
+  set->vx = NULL;
+  set->vy = NULL;
+  set->vz = NULL;
+  set->color = NULL;
+  set->fade = NULL;
+  set->dead = NULL;
+  set->layout = 0;
+}
+
+bool particle_set_resize (particle_set* set, int size)
+{
+  particle_set_free (set);
+  if (size < 0)
+    return false;
+  int capacity = padded (size);
+  if (capacity == 0)
+    return true;
+
+  set->x = aligned_floats (capacity);
+  set->y = aligned_floats (capacity);
+  set->z = aligned_floats (capacity);
+  set->vx = aligned_floats (capacity);
+  set->vy = aligned_floats (capacity);
+  set->vz = aligned_floats (capacity);
+  set->color = aligned_floats (capacity);
+  set->fade = aligned_floats (capacity);
+  set->dead = (int*) aligned_block (capacity, sizeof(int));
+  if (set->x == NULL || set->y == NULL || set->z == NULL || set->vx == NULL || set->vy == NULL ||
+      set->vz == NULL || set->color == NULL || set->fade == NULL || set->dead == NULL)
+  {
+    particle_set_free (set);
+    return false;
+  }
+  set->size = size;
+  set->capacity = capacity;
+  return true;
+}
+
+void particle_set_clear (particle_set* set)
+{
+  set->count = 0;
+  set->layout++;
+  clear_tail (set);
+}
+
+void particle_set_free (particle_set* set)
+{
+  free (set->x);
+  free (set->y);
+  free (set->z);
+  free (set->vx);
+  free (set->vy);
+  free (set->vz);
+  free (set->color);
+  free (set->fade);
+  free (set->dead);
+  particle_set_init (set);
+}
+
+/**xorshift32, state never 0
+*/
+static inline unsigned int next_bits (unsigned int* s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+/**speed/10000 to speed*1.0001, half of them negative; at speed 0.1 the old nextRand range
+*/
+static inline float emit_speed (unsigned int* s, float speed)
+{
+  unsigned int bits = next_bits (s);
+  float v = (float)(bits >> 8) * (speed / 16777216.0f) + speed * 0.0001f;
+  return (bits & 1) ? -v : v;
+}
+
+void particle_emitter_init (particle_emitter* em, unsigned int seed)
+{
+  em->x = em->y = em->z = 0.0f;
+  em->speed = 0.1f;
+  em->life = 0.0f;
+  em->rate = 0.0f;
+  em->burst = 0;
+  em->carry = 0.0f;
+  em->rng = seed * 2654435761u + 0x9e3779b9u;
+  if (em->rng == 0)
+    em->rng = 1;
+}
+
+int particle_emit (particle_set* set, particle_emitter* em)
+{
+  int n = em->burst;
+  em->burst = 0;
+  if (em->rate > 0.0f)
+  {
+    float due = em->carry + em->rate;
+    int whole = (int)due;
+    em->carry = due - (float)whole;
+    n += whole;
+  }
+  if (n > set->size - set->count)
+    n = set->size - set->count;
+  if (n <= 0)
+    return 0;
+
+  float fade = em->life > 0.0f ? 1.0f / em->life : 0.0f;
+  for (int i=set->count; i<set->count+n; i++)
+  {
+    set->x[i] = em->x;
+    set->y[i] = em->y;
+    set->z[i] = em->z;
+    set->vx[i] = emit_speed (&em->rng, em->speed);
+    set->vy[i] = emit_speed (&em->rng, em->speed);
+    set->vz[i] = emit_speed (&em->rng, em->speed);
+    set->color[i] = 1.0f;
+    set->fade[i] = fade;
+  }
+  set->count += n;
+  clear_tail (set);
+  return n;
+}
+
+/**Step particles [first, last) of from into to and list the ones that died below count in
+ * dead, ascending; first and last are multiples of PARTICLE_LANES
+ * @return number that died
+*/
+static int step_range (const particle_set* from, particle_set* to, int first, int last, int count, int* dead)
+{
+  int died = 0;
+  int i = first;
+  //in place the velocities and fades are already there
+  bool copy = from != to;
+
+#if defined(__AVX2__)
+  const __m256 zero = _mm256_setzero_ps();
+  for (; i<last; i+=8)
+  {
+    __m256 vx = _mm256_load_ps (from->vx + i);
+    __m256 vy = _mm256_load_ps (from->vy + i);
+    __m256 vz = _mm256_load_ps (from->vz + i);
+    __m256 f = _mm256_load_ps (from->fade + i);
+    _mm256_store_ps (to->x + i, _mm256_add_ps (_mm256_load_ps (from->x + i), vx));
+    _mm256_store_ps (to->y + i, _mm256_add_ps (_mm256_load_ps (from->y + i), vy));
+    _mm256_store_ps (to->z + i, _mm256_add_ps (_mm256_load_ps (from->z + i), vz));
+    if (copy)
+    {
+      _mm256_store_ps (to->vx + i, vx);
+      _mm256_store_ps (to->vy + i, vy);
+      _mm256_store_ps (to->vz + i, vz);
+      _mm256_store_ps (to->fade + i, f);
+    }
+    __m256 c = _mm256_sub_ps (_mm256_load_ps (from->color + i), f);
+    _mm256_store_ps (to->color + i, c);
+    for (int m = _mm256_movemask_ps (_mm256_cmp_ps (c, zero, _CMP_LE_OQ)); m != 0; m &= m - 1)
+      if (i + __builtin_ctz (m) < count)
+        dead[died++] = i + __builtin_ctz (m);
+  }
+#elif defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps();
+  for (; i<last; i+=4)
+  {
+    __m128 vx = _mm_load_ps (from->vx + i);
+    __m128 vy = _mm_load_ps (from->vy + i);
+    __m128 vz = _mm_load_ps (from->vz + i);
+    __m128 f = _mm_load_ps (from->fade + i);
+    _mm_store_ps (to->x + i, _mm_add_ps (_mm_load_ps (from->x + i), vx));
+    _mm_store_ps (to->y + i, _mm_add_ps (_mm_load_ps (from->y + i), vy));
+    _mm_store_ps (to->z + i, _mm_add_ps (_mm_load_ps (from->z + i), vz));
+    if (copy)
+    {
+      _mm_store_ps (to->vx + i, vx);
+      _mm_store_ps (to->vy + i, vy);
+      _mm_store_ps (to->vz + i, vz);
+      _mm_store_ps (to->fade + i, f);
+    }
+    __m128 c = _mm_sub_ps (_mm_load_ps (from->color + i), f);
+    _mm_store_ps (to->color + i, c);
+    for (int m = _mm_movemask_ps (_mm_cmple_ps (c, zero)); m != 0; m &= m - 1)
+      if (i + __builtin_ctz (m) < count)
+        dead[died++] = i + __builtin_ctz (m);
+  }
+#endif
+  for (; i<last; i++)
+  {
+    to->x[i] = from->x[i] + from->vx[i];
+    to->y[i] = from->y[i] + from->vy[i];
+    to->z[i] = from->z[i] + from->vz[i];
+    if (copy)
+    {
+      to->vx[i] = from->vx[i];
+      to->vy[i] = from->vy[i];
+      to->vz[i] = from->vz[i];
+      to->fade[i] = from->fade[i];
+    }
+    to->color[i] = from->color[i] - from->fade[i];
+    if (to->color[i] <= 0.0f && i < count)
+      dead[died++] = i;
+  }
+  return died;
+}
+
+/**Step particles [first, last) of from into to under forces, as step_range. One pass: the
+ * acceleration of every force is summed in registers, added to the velocity, drag scales
+ * it, and the position moves by the new velocity (semi-implicit Euler)
+*/
+static int step_range_forces (const particle_set* from, particle_set* to, int first, int last, int count, int* dead,
+                              const particle_forces* forces)
+{
+  const particle_forces* F = forces;
+  int died = 0;
+  int i = first;
+  bool drag = F->drag != 0.0f || F->drag2 != 0.0f;
+  //in place the fades are already there
+  bool copy = from != to;
+
+#if defined(__AVX2__)
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps (1.0f);
+  for (; i<last; i+=8)
+  {
+    __m256 x = _mm256_load_ps (from->x + i);
+    __m256 y = _mm256_load_ps (from->y + i);
+    __m256 z = _mm256_load_ps (from->z + i);
+    __m256 ax = _mm256_set1_ps (F->gx);
+    __m256 ay = _mm256_set1_ps (F->gy);
+    __m256 az = _mm256_set1_ps (F->gz);
+    for (int a=0; a<F->attractors; a++)
+    {
+      const particle_attractor* A = &F->attractor[a];
+      __m256 dx = _mm256_sub_ps (_mm256_set1_ps (A->x), x);
+      __m256 dy = _mm256_sub_ps (_mm256_set1_ps (A->y), y);
+      __m256 dz = _mm256_sub_ps (_mm256_set1_ps (A->z), z);
+      __m256 r2 = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (dx, dx), _mm256_mul_ps (dy, dy)),
+                                 _mm256_add_ps (_mm256_mul_ps (dz, dz), _mm256_set1_ps (A->soften)));
+      __m256 inv = _mm256_div_ps (one, _mm256_sqrt_ps (r2));
+      __m256 k = _mm256_mul_ps (_mm256_set1_ps (A->strength), _mm256_mul_ps (inv, _mm256_mul_ps (inv, inv)));
+      ax = _mm256_add_ps (ax, _mm256_mul_ps (k, dx));
+      ay = _mm256_add_ps (ay, _mm256_mul_ps (k, dy));
+      az = _mm256_add_ps (az, _mm256_mul_ps (k, dz));
+    }
+    for (int v=0; v<F->vortices; v++)
+    {
+      const particle_vortex* V = &F->vortex[v];
+      __m256 dx = _mm256_sub_ps (x, _mm256_set1_ps (V->x));
+      __m256 dy = _mm256_sub_ps (y, _mm256_set1_ps (V->y));
+      __m256 dz = _mm256_sub_ps (z, _mm256_set1_ps (V->z));
+      __m256 ux = _mm256_set1_ps (V->ax);
+      __m256 uy = _mm256_set1_ps (V->ay);
+      __m256 uz = _mm256_set1_ps (V->az);
+      //squared distance to the line: |d|^2 less the part along the axis
+      __m256 along = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (ux, dx), _mm256_mul_ps (uy, dy)), _mm256_mul_ps (uz, dz));
+      __m256 r2 = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (dx, dx), _mm256_mul_ps (dy, dy)), _mm256_mul_ps (dz, dz));
+      r2 = _mm256_add_ps (_mm256_sub_ps (r2, _mm256_mul_ps (along, along)), _mm256_set1_ps (V->soften));
+      __m256 k = _mm256_div_ps (_mm256_set1_ps (V->strength), r2);
+      ax = _mm256_add_ps (ax, _mm256_mul_ps (k, _mm256_sub_ps (_mm256_mul_ps (uy, dz), _mm256_mul_ps (uz, dy))));
+      ay = _mm256_add_ps (ay, _mm256_mul_ps (k, _mm256_sub_ps (_mm256_mul_ps (uz, dx), _mm256_mul_ps (ux, dz))));
+      az = _mm256_add_ps (az, _mm256_mul_ps (k, _mm256_sub_ps (_mm256_mul_ps (ux, dy), _mm256_mul_ps (uy, dx))));
+    }
+    __m256 vx = _mm256_add_ps (_mm256_load_ps (from->vx + i), ax);
+    __m256 vy = _mm256_add_ps (_mm256_load_ps (from->vy + i), ay);
+    __m256 vz = _mm256_add_ps (_mm256_load_ps (from->vz + i), az);
+    if (drag)
+    {
+      __m256 speed = _mm256_sqrt_ps (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (vx, vx), _mm256_mul_ps (vy, vy)),
+                                                    _mm256_mul_ps (vz, vz)));
+      __m256 k = _mm256_div_ps (_mm256_set1_ps (1.0f - F->drag),
+                                _mm256_add_ps (one, _mm256_mul_ps (_mm256_set1_ps (F->drag2), speed)));
+      vx = _mm256_mul_ps (vx, k);
+      vy = _mm256_mul_ps (vy, k);
+      vz = _mm256_mul_ps (vz, k);
+    }
+    _mm256_store_ps (to->x + i, _mm256_add_ps (x, vx));
+    _mm256_store_ps (to->y + i, _mm256_add_ps (y, vy));
+    _mm256_store_ps (to->z + i, _mm256_add_ps (z, vz));
+    _mm256_store_ps (to->vx + i, vx);
+    _mm256_store_ps (to->vy + i, vy);
+    _mm256_store_ps (to->vz + i, vz);
+    __m256 f = _mm256_load_ps (from->fade + i);
+    if (copy)
+      _mm256_store_ps (to->fade + i, f);
+    __m256 c = _mm256_sub_ps (_mm256_load_ps (from->color + i), f);
+    _mm256_store_ps (to->color + i, c);
+    for (int m = _mm256_movemask_ps (_mm256_cmp_ps (c, zero, _CMP_LE_OQ)); m != 0; m &= m - 1)
+      if (i + __builtin_ctz (m) < count)
+        dead[died++] = i + __builtin_ctz (m);
+  }
+#elif defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps (1.0f);
+  for (; i<last; i+=4)
+  {
+    __m128 x = _mm_load_ps (from->x + i);
+    __m128 y = _mm_load_ps (from->y + i);
+    __m128 z = _mm_load_ps (from->z + i);
+    __m128 ax = _mm_set1_ps (F->gx);
+    __m128 ay = _mm_set1_ps (F->gy);
+    __m128 az = _mm_set1_ps (F->gz);
+    for (int a=0; a<F->attractors; a++)
+    {
+      const particle_attractor* A = &F->attractor[a];
+      __m128 dx = _mm_sub_ps (_mm_set1_ps (A->x), x);
+      __m128 dy = _mm_sub_ps (_mm_set1_ps (A->y), y);
+      __m128 dz = _mm_sub_ps (_mm_set1_ps (A->z), z);
+      __m128 r2 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)),
+                              _mm_add_ps (_mm_mul_ps (dz, dz), _mm_set1_ps (A->soften)));
+      __m128 inv = _mm_div_ps (one, _mm_sqrt_ps (r2));
+      __m128 k = _mm_mul_ps (_mm_set1_ps (A->strength), _mm_mul_ps (inv, _mm_mul_ps (inv, inv)));
+      ax = _mm_add_ps (ax, _mm_mul_ps (k, dx));
+      ay = _mm_add_ps (ay, _mm_mul_ps (k, dy));
+      az = _mm_add_ps (az, _mm_mul_ps (k, dz));
+    }
+    for (int v=0; v<F->vortices; v++)
+    {
+      const particle_vortex* V = &F->vortex[v];
+      __m128 dx = _mm_sub_ps (x, _mm_set1_ps (V->x));
+      __m128 dy = _mm_sub_ps (y, _mm_set1_ps (V->y));
+      __m128 dz = _mm_sub_ps (z, _mm_set1_ps (V->z));
+      __m128 ux = _mm_set1_ps (V->ax);
+      __m128 uy = _mm_set1_ps (V->ay);
+      __m128 uz = _mm_set1_ps (V->az);
+      __m128 along = _mm_add_ps (_mm_add_ps (_mm_mul_ps (ux, dx), _mm_mul_ps (uy, dy)), _mm_mul_ps (uz, dz));
+      __m128 r2 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz));
+      r2 = _mm_add_ps (_mm_sub_ps (r2, _mm_mul_ps (along, along)), _mm_set1_ps (V->soften));
+      __m128 k = _mm_div_ps (_mm_set1_ps (V->strength), r2);
+      ax = _mm_add_ps (ax, _mm_mul_ps (k, _mm_sub_ps (_mm_mul_ps (uy, dz), _mm_mul_ps (uz, dy))));
+      ay = _mm_add_ps (ay, _mm_mul_ps (k, _mm_sub_ps (_mm_mul_ps (uz, dx), _mm_mul_ps (ux, dz))));
+      az = _mm_add_ps (az, _mm_mul_ps (k, _mm_sub_ps (_mm_mul_ps (ux, dy), _mm_mul_ps (uy, dx))));
+    }
+    __m128 vx = _mm_add_ps (_mm_load_ps (from->vx + i), ax);
+    __m128 vy = _mm_add_ps (_mm_load_ps (from->vy + i), ay);
+    __m128 vz = _mm_add_ps (_mm_load_ps (from->vz + i), az);
+    if (drag)
+    {
+      __m128 speed = _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (vx, vx), _mm_mul_ps (vy, vy)),
+                                              _mm_mul_ps (vz, vz)));
+      __m128 k = _mm_div_ps (_mm_set1_ps (1.0f - F->drag),
+                             _mm_add_ps (one, _mm_mul_ps (_mm_set1_ps (F->drag2), speed)));
+      vx = _mm_mul_ps (vx, k);
+      vy = _mm_mul_ps (vy, k);
+      vz = _mm_mul_ps (vz, k);
+    }
+    _mm_store_ps (to->x + i, _mm_add_ps (x, vx));
+    _mm_store_ps (to->y + i, _mm_add_ps (y, vy));
+    _mm_store_ps (to->z + i, _mm_add_ps (z, vz));
+    _mm_store_ps (to->vx + i, vx);
+    _mm_store_ps (to->vy + i, vy);
+    _mm_store_ps (to->vz + i, vz);
+    __m128 f = _mm_load_ps (from->fade + i);
+    if (copy)
+      _mm_store_ps (to->fade + i, f);
+    __m128 c = _mm_sub_ps (_mm_load_ps (from->color + i), f);
+    _mm_store_ps (to->color + i, c);
+    for (int m = _mm_movemask_ps (_mm_cmple_ps (c, zero)); m != 0; m &= m - 1)
+      if (i + __builtin_ctz (m) < count)
+        dead[died++] = i + __builtin_ctz (m);
+  }
+#endif
+  for (; i<last; i++)
+  {
+    float x = from->x[i], y = from->y[i], z = from->z[i];
+    float ax = F->gx, ay = F->gy, az = F->gz;
+    for (int a=0; a<F->attractors; a++)
+    {
+      const particle_attractor* A = &F->attractor[a];
+      float dx = A->x - x, dy = A->y - y, dz = A->z - z;
+      float inv = 1.0f / sqrtf ((dx * dx + dy * dy) + (dz * dz + A->soften));
+      float k = A->strength * (inv * (inv * inv));
+      ax += k * dx;
+      ay += k * dy;
+      az += k * dz;
+    }
+    for (int v=0; v<F->vortices; v++)
+    {
+      const particle_vortex* V = &F->vortex[v];
+      float dx = x - V->x, dy = y - V->y, dz = z - V->z;
+      float along = (V->ax * dx + V->ay * dy) + V->az * dz;
+      float k = V->strength / ((((dx * dx + dy * dy) + dz * dz) - along * along) + V->soften);
+      ax += k * (V->ay * dz - V->az * dy);
+      ay += k * (V->az * dx - V->ax * dz);
+      az += k * (V->ax * dy - V->ay * dx);
+    }
+    float vx = from->vx[i] + ax, vy = from->vy[i] + ay, vz = from->vz[i] + az;
+    if (drag)
+    {
+      float k = (1.0f - F->drag) / (1.0f + F->drag2 * sqrtf ((vx * vx + vy * vy) + vz * vz));
+      vx *= k;
+      vy *= k;
+      vz *= k;
+    }
+    to->x[i] = x + vx;
+    to->y[i] = y + vy;
+    to->z[i] = z + vz;
+    to->vx[i] = vx;
+    to->vy[i] = vy;
+    to->vz[i] = vz;
+    if (copy)
+      to->fade[i] = from->fade[i];
+    to->color[i] = from->color[i] - from->fade[i];
+    if (to->color[i] <= 0.0f && i < count)
+      dead[died++] = i;
+  }
+  return died;
+}
+
+/**Fill the slots listed in set->dead (ascending, died of them, all below count) with the
+ * last live particles, then shrink count. Only the holes below the new count are filled,
+ * each with one move of every attribute
+*/
+static void remove_dead (particle_set* set, int died)
+{
+  const int* dead = set->dead;
+  int live = set->count - died;
+  int src = set->count - 1;
+  int tail = died - 1;
+  bool moved = false;
+
+  for (int k=0; k<died && dead[k]<live; k++)
+  {
+    //the last slots may be dead themselves
+    while (tail >= 0 && dead[tail] == src)
+    {
+      tail--;
+      src--;
+    }
+    int d = dead[k];
+    set->x[d] = set->x[src];
+    set->y[d] = set->y[src];
+    set->z[d] = set->z[src];
+    set->vx[d] = set->vx[src];
+    set->vy[d] = set->vy[src];
+    set->vz[d] = set->vz[src];
+    set->color[d] = set->color[src];
+    set->fade[d] = set->fade[src];
+    src--;
+    moved = true;
+  }
+  if (moved)
+    set->layout++;
+  set->count = live;
+  clear_tail (set);
+}
+
+/**Forces that change anything
+*/
+static bool forces_active (const particle_forces* forces)
+{
+  return forces != NULL && (forces->gx != 0.0f || forces->gy != 0.0f || forces->gz != 0.0f ||
+                            forces->drag != 0.0f || forces->drag2 != 0.0f ||
+                            forces->attractors > 0 || forces->vortices > 0);
+}
+
+/**Steps [first, last) with or without forces
+*/
+static int step_chunk (const particle_set* from, particle_set* to, int first, int last, int count, int* dead,
+                       const particle_forces* forces)
+{
+  if (forces != NULL)
+    return step_range_forces (from, to, first, last, count, dead, forces);
+  return step_range (from, to, first, last, count, dead);
+}
+
+void particle_forces_init (particle_forces* forces)
+{
+  memset (forces, 0, sizeof(*forces));
+}
+
+int particle_set_step (const particle_set* from, particle_set* to, const particle_forces* forces, int threads)
+{
+  if (!forces_active (forces))
+    forces = NULL;
+  int count = from->count;
+  int last = padded (count);
+  int chunk = chunk_size();
+  int died = 0;
+
+  if (last <= chunk || threads == 1)
+  {
+    died = step_chunk (from, to, 0, last, count, to->dead, forces);
+  }
+  else
+  {
+    //every chunk lists its dead in its own part of to->dead, then the lists are joined
+    int chunks = (last + chunk - 1) / chunk;
+    std::vector<int> chunk_died (chunks, 0);
+    aclib::parallel_for (chunks, threads, [&](int c)
+    {
+      int first = c * chunk;
+      int end = first + chunk < last ? first + chunk : last;
+      chunk_died[c] = step_chunk (from, to, first, end, count, to->dead + first, forces);
+    });
+    for (int c=0; c<chunks; c++)
+    {
+      if (chunk_died[c] > 0 && died != c * chunk)
+        memmove (to->dead + died, to->dead + c * chunk, chunk_died[c] * sizeof(int));
+      died += chunk_died[c];
+    }
+  }
+  to->count = count;
+  to->layout = from->layout;
+  remove_dead (to, died);
+  return to->count;
+}
+
+/**Vertices of one particle at out: a triangle (3) or a point (1)
+ * @return number of vertices written
+*/
+static inline int put_vertices (particle_vertex* out, float c, float x, float y, float z, bool triangles, float size)
+{
+  particle_vertex v;
+  v.r = v.g = (unsigned char)(c * 255.0f + 0.5f);
+  v.b = 0;
+  v.a = 0xff;
+  v.x = x;
+  v.y = y;
+  v.z = z;
+  if (!triangles)
+  {
+    *out = v;
+    return 1;
+  }
+  //same triangle the old glBegin loop drew
+  out[0] = out[1] = out[2] = v;
+  out[0].x += size;
+  out[1].x += size;
+  out[1].y += size;
+  out[2].y += size;
+  return 3;
+}
+
+/**Vertices of the particles [first, last), from out on
+ * @return number of vertices written
+*/
+static int pack_range (const particle_set* set, int first, int last, bool triangles, float size, particle_vertex* out)
+{
+  particle_vertex* start = out;
+
+  for (int i=first; i<last; i++)
+    out += put_vertices (out, set->color[i], set->x[i], set->y[i], set->z[i], triangles, size);
+  return (int)(out - start);
+}
+
+int particle_set_pack (const particle_set* set, bool triangles, float size, particle_vertex* out, int threads)
+{
+  int per = triangles ? 3 : 1;
+  int chunk = chunk_size();
+  int chunks = (set->count + chunk - 1) / chunk;
+  if (chunks <= 1 || threads == 1)
+    return pack_range (set, 0, set->count, triangles, size, out);
+
+  //live particles are dense, so every chunk knows where its vertices go
+  aclib::parallel_for (chunks, threads, [&](int c)
+  {
+    int last = (c + 1) * chunk < set->count ? (c + 1) * chunk : set->count;
+    pack_range (set, c * chunk, last, triangles, size, out + (size_t)c * chunk * per);
+  });
+  return set->count * per;
+}
+
+/**Particles of [first, last) still alive t steps after the start
+*/
+static int count_alive_at (const particle_set* set, int first, int last, float t)
+{
+  int n = 0;
+  for (int i=first; i<last; i++)
+    n += set->color[i] - set->fade[i] * t > 0.0f ? 1 : 0;
+  return n;
+}
+
+/**Vertices t steps after the start of the particles of [first, last) still alive then,
+ * from out on
+ * @return number of vertices written
+*/
+static int pack_range_at (const particle_set* set, int first, int last, float t, bool triangles, float size, particle_vertex* out)
+{
+  particle_vertex* start = out;
+
+  for (int i=first; i<last; i++)
+  {
+    float c = set->color[i] - set->fade[i] * t;
+    if (c <= 0.0f)
+      continue;
+    out += put_vertices (out, c, set->x[i] + set->vx[i] * t, set->y[i] + set->vy[i] * t,
+                         set->z[i] + set->vz[i] * t, triangles, size);
+  }
+  return (int)(out - start);
+}
+
+int particle_set_pack_at (const particle_set* set, float t, bool triangles, float size, particle_vertex* out, int threads)
+{
+  int per = triangles ? 3 : 1;
+  int chunk = chunk_size();
+  int chunks = (set->count + chunk - 1) / chunk;
+  if (chunks <= 1 || threads == 1)
+    return pack_range_at (set, 0, set->count, t, triangles, size, out);
+
+  //count every chunk, then each chunk writes from its prefix sum
+  std::vector<int> first_vertex (chunks + 1, 0);
+  aclib::parallel_for (chunks, threads, [&](int c)
+  {
+    int last = (c + 1) * chunk < set->count ? (c + 1) * chunk : set->count;
+    first_vertex[c+1] = count_alive_at (set, c * chunk, last, t) * per;
+  });
+  for (int c=0; c<chunks; c++)
+    first_vertex[c+1] += first_vertex[c];
+  aclib::parallel_for (chunks, threads, [&](int c)
+  {
+    int last = (c + 1) * chunk < set->count ? (c + 1) * chunk : set->count;
+    pack_range_at (set, c * chunk, last, t, triangles, size, out + first_vertex[c]);
+  });
+  return first_vertex[chunks];
+}
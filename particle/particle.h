@@ -0,0 +1,177 @@
+/**Author: Un Hou (Albert) Chan
+ * Particle pool of project 2, kept as a structure of arrays.
+ * Dependancy: "../aclib/parallel.h"
+ *
+ * Every attribute is its own float array, 32 byte aligned and padded to a multiple of
+ * PARTICLE_LANES, so a step is a plain stride-1 loop over whole vectors: AVX2 moves 8
+ * particles at once, SSE2 4, and the scalar loop is left for other targets.
+ *
+ * The arrays are allocated once for size particles. Live particles always fill [0, count):
+ * emitters append at count, and a step fills the slots of the particles that died with the
+ * last live ones (swap-remove), so nothing is allocated per step and neither the step nor
+ * the drawing touches a dead slot. Particle order is not kept: layout counts the times
+ * particles changed slots, so anything holding slot numbers can tell when they went stale.
+ * Slots from count up to the next multiple of PARTICLE_LANES are zero.
+ *
+ * A burst of particles moves with constant velocity, so it also has a closed form: t steps
+ * after the burst a particle is at x + vx * t with color - fade * t. particle_set_pack_at
+ * draws any time straight from the emitted state, without stepping or writing the set.
+*/
+#pragma once
+
+//particles per AVX register; arrays are padded to a multiple of it
+#define PARTICLE_LANES 8
+//most attractors and vortices of one particle_forces
+#define PARTICLE_MAX_ATTRACTORS 4
+#define PARTICLE_MAX_VORTICES 4
+
+/**int count; live particles, [0, count)
+ * int size; most particles alive at once
+ * int capacity; padded length of every array
+ * float* x, *y, *z; positions
+ * float* vx, *vy, *vz; velocities, world unit per step
+ * float* color; remaining life, 1 when emitted, dead at 0
+ * float* fade; color lost per step, 1 / lifetime in steps, 0 lives forever
+ * int* dead; scratch of the step, slots that died
+ * unsigned int layout; bumped whenever live particles move to other slots or the set is
+ *   cleared (appending does not), copied by a step to its target
+*/
+typedef struct particle_set
+{
+  int count;
+  int size;
+  int capacity;
+  float* x;
+  float* y;
+  float* z;
+  float* vx;
+  float* vy;
+  float* vz;
+  float* color;
+  float* fade;
+  int* dead;
+  unsigned int layout;
+} particle_set;
+
+/**Source of particles, all with full color, flying off in a random direction with each
+ * velocity component in +-[speed/10000, speed*1.0001].
+ * float x, y, z; where particles start
+ * float speed; largest velocity component, world unit per step
+ * float life; lifetime in steps, 0 or less lives forever
+ * float rate; continuous emission, particles per step (may be fractional)
+ * int burst; particles emitted at once by the next particle_emit
+ * float carry; fraction of a particle owed by rate
+ * unsigned int rng; random state
+*/
+typedef struct particle_emitter
+{
+  float x, y, z;
+  float speed;
+  float life;
+  float rate;
+  int burst;
+  float carry;
+  unsigned int rng;
+} particle_emitter;
+
+/**Point pulling particles toward it, inverse square.
+ * float x, y, z; position
+ * float strength; acceleration at distance 1, world unit per step squared; negative pushes
+ * float soften; added to the squared distance, > 0 keeps the pull finite at the point
+*/
+typedef struct particle_attractor
+{
+  float x, y, z;
+  float strength;
+  float soften;
+} particle_attractor;
+
+/**Line particles swirl around, pushed along axis x d (d from the center), falling off as 1 over
+ * the distance to the line, wherever along it the particle is.
+ * float x, y, z; a point of the line
+ * float ax, ay, az; direction of the line, unit length; the swirl is counterclockwise about it
+ * float strength; acceleration at distance 1, world unit per step squared
+ * float soften; added to the squared distance to the line, > 0 keeps the swirl finite on it
+*/
+typedef struct particle_vortex
+{
+  float x, y, z;
+  float ax, ay, az;
+  float strength;
+  float soften;
+} particle_vortex;
+
+/**Forces of a step, applied together in one pass over the particles: the accelerations
+ * are summed, added to the velocity, then drag scales the velocity by
+ * (1 - drag) / (1 + drag2 * speed), and the position moves by it.
+ * float gx, gy, gz; uniform gravity, world unit per step squared
+ * float drag; linear drag, fraction of the velocity lost per step
+ * float drag2; quadratic drag, per unit of speed
+ * int attractors, vortices; used entries of attractor and vortex
+*/
+typedef struct particle_forces
+{
+  float gx, gy, gz;
+  float drag;
+  float drag2;
+  int attractors;
+  particle_attractor attractor[PARTICLE_MAX_ATTRACTORS];
+  int vortices;
+  particle_vortex vortex[PARTICLE_MAX_VORTICES];
+} particle_forces;
+
+/**Vertex as drawn, the GL_C4UB_V3F interleaved layout: color then position, 16 bytes
+*/
+typedef struct particle_vertex
+{
+  unsigned char r, g, b, a;
+  float x, y, z;
+} particle_vertex;
+
+/**Initialize an empty set. Must be called before particle_set_resize
+*/
+void particle_set_init (particle_set* set);
+/**Make room for size particles, none alive. Contents are not kept
+ * @return false if out of memory, the set is then empty
+*/
+bool particle_set_resize (particle_set* set, int size);
+void particle_set_free (particle_set* set);
+/**Kill every particle
+*/
+void particle_set_clear (particle_set* set);
+/**No forces at all
+*/
+void particle_forces_init (particle_forces* forces);
+/**One step: every live particle of from moved by its velocity and its color lowered by its
+ * fade, written to to, then the ones down to 0 removed. to may be from; otherwise it must
+ * have the same size and gets every attribute, so from is only read and can be drawn meanwhile.
+ * @param forces changes the velocities first, in the same pass; NULL (or none set) for none
+ * @param threads <= 0 means one per hardware thread. Tasks are chunks sized to the L2 cache
+ * @return live particles of to
+*/
+int particle_set_step (const particle_set* from, particle_set* to, const particle_forces* forces, int threads);
+/**Emitter at the origin, speed 0.1 like the old explosion, immortal, nothing to emit.
+ * Same seed, same particles
+*/
+void particle_emitter_init (particle_emitter* em, unsigned int seed);
+/**Append the pending burst and this step's share of rate to set, as far as size allows;
+ * what does not fit is dropped
+ * @return particles emitted
+*/
+int particle_emit (particle_set* set, particle_emitter* em);
+/**Write the vertices of every live particle to out, in particle order: a yellow triangle
+ * of side size in the XY plane (3 vertices) or a point (1 vertex).
+ * @param out room for count vertices, times 3 for triangles. May be a mapped buffer
+ * @param threads <= 0 means one per hardware thread. Tasks are chunks sized to the L2 cache
+ * @return number of vertices written
+*/
+int particle_set_pack (const particle_set* set, bool triangles, float size, particle_vertex* out, int threads);
+/**Like particle_set_pack, but t steps after the state held in set (fractions allowed):
+ * positions x + vx * t, colors color - fade * t, and only the particles still alive then.
+ * The set is only read, so any t can be drawn in any order. Matches stepping the set t
+ * times up to float rounding, as long as none of its particles was emitted later and no
+ * forces act.
+ * @param out room for count vertices, times 3 for triangles. May be a mapped buffer
+ * @return number of vertices written
+*/
+int particle_set_pack_at (const particle_set* set, float t, bool triangles, float size, particle_vertex* out, int threads);
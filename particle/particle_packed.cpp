@@ -0,0 +1,426 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "particle_packed.h", "particle.h", "../aclib/parallel.h"
+*/
+
+#include "particle_packed.h"
+#include "../aclib/parallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#if defined(__AVX2__) && defined(__F16C__)
+  #include <immintrin.h>
+#endif
+
+//alignment of every array, one AVX register
+#define PACKED_ALIGN 32
+//bytes a step touches per particle: 8 shorts read, 4 written
+#define PACKED_STEP_BYTES (12 * sizeof(unsigned short))
+//largest position, in quanta
+#define PACKED_TOP 65535.0f
+
+/**Particles per thread task, half the L2 cache of working set as particle_set_step
+*/
+static int compute_chunk ()
+{
+  int c = (int)(aclib::l2_cache_bytes() / 2 / PACKED_STEP_BYTES) / PARTICLE_LANES * PARTICLE_LANES;
+  return c > PARTICLE_LANES * 64 ? c : PARTICLE_LANES * 64;
+}
+
+static int chunk_size ()
+{
+  static const int chunk = compute_chunk();
+  return chunk;
+}
+
+static inline int padded (int n)
+{
+  return (n + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+}
+
+static void* aligned_block (int n, size_t item)
+{
+  void* p = NULL;
+  if (posix_memalign (&p, PACKED_ALIGN, (size_t)n * item) != 0)
+    return NULL;
+  memset (p, 0, (size_t)n * item);
+  return p;
+}
+
+static unsigned short* aligned_shorts (int n)
+{
+  return (unsigned short*) aligned_block (n, sizeof(unsigned short));
+}
+
+/**Zero the slots from count to the next multiple of PARTICLE_LANES
+*/
+static void clear_tail (particle_packed* set)
+{
+  for (int i=set->count; i<padded (set->count); i++)
+  {
+    set->x[i] = set->y[i] = set->z[i] = 0;
+    set->vx[i] = set->vy[i] = set->vz[i] = 0;
+    set->color[i] = set->fade[i] = 0;
+  }
+}
+
+/**IEEE half float of f, rounded to nearest even; past the range becomes infinity
+*/
+static unsigned short float_to_half (float f)
+{
+  unsigned int u;
+  memcpy (&u, &f, sizeof(u));
+  unsigned short sign = (unsigned short)((u >> 16) & 0x8000);
+  u &= 0x7fffffff;
+  if (u >= 0x47800000)
+    return sign | (u > 0x7f800000 ? 0x7e00 : 0x7c00);
+  //below the smallest normal half: whole units of 2^-24
+  if (u < 0x38800000)
+    return sign | (unsigned short)rintf (fabsf (f) * 16777216.0f);
+  //rebias the exponent from 127 to 15 and round away the low 13 bits
+  return sign | (unsigned short)((u + 0xc8000fffu + ((u >> 13) & 1)) >> 13);
+}
+
+/**Float of the IEEE half float h, exact
+*/
+static inline float half_to_float (unsigned short h)
+{
+  unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+  unsigned int e = (h >> 10) & 0x1f;
+  unsigned int m = h & 0x3ff;
+  unsigned int u;
+  if (e == 0)
+  {
+    float f = (float)m * (1.0f / 16777216.0f);
+    memcpy (&u, &f, sizeof(u));
+    u |= sign;
+  }
+  else if (e == 31)
+    u = sign | 0x7f800000 | (m << 13);
+  else
+    u = sign | ((e + 112) << 23) | (m << 13);
+  float f;
+  memcpy (&f, &u, sizeof(f));
+  return f;
+}
+
+/**Quanta of p along one axis, rounded to nearest and clamped to the box
+*/
+static inline unsigned short quantize (float p, float lo, float inv_scale)
+{
+  float q = floorf ((p - lo) * inv_scale + 0.5f);
+  return (unsigned short)(q < 0.0f ? 0.0f : (q > PACKED_TOP ? PACKED_TOP : q));
+}
+
+/**Velocity v in quanta per step, within the largest finite half float
+*/
+static inline float velocity_quanta (float v, float inv_scale)
+{
+  float q = v * inv_scale;
+  return q < -65504.0f ? -65504.0f : (q > 65504.0f ? 65504.0f : q);
+}
+
+/**Life in units of 1/65535, rounded to nearest and clamped to [0, 65535]
+*/
+static inline unsigned short life_units (float c)
+{
+  float q = floorf (c * PACKED_TOP + 0.5f);
+  return (unsigned short)(q < 0.0f ? 0.0f : (q > PACKED_TOP ? PACKED_TOP : q));
+}
+
+/**Bits of slot i at a step: 10 of them for the rounding offset of every axis
+*/
+static inline unsigned int slot_bits (unsigned int i, unsigned int seed)
+{
+  unsigned int h = i * 0x9e3779b1u ^ seed;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 13;
+  return h;
+}
+
+/**Rounding offset in [0, 1) of axis a (0 to 2) from the bits of a slot
+*/
+static inline float offset_of (unsigned int h, int a)
+{
+  return (float)((h >> (a * 10)) & 1023) * (1.0f / 1024.0f);
+}
+
+/**Moved position of quanta q by velocity v, in quanta: the fraction of a quantum rounds up
+ * with probability equal to itself, so the mean move is exact however small. Truncation is
+ * the floor wherever the result is not clamped to 0
+*/
+static inline unsigned short move_quanta (unsigned short q, unsigned short v, float offset)
+{
+  int p = (int)(((float)q + half_to_float (v)) + offset);
+  return (unsigned short)(p < 0 ? 0 : (p > 65535 ? 65535 : p));
+}
+
+void particle_packed_init (particle_packed* set)
+{
+  set->count = 0;
+  set->size = 0;
+  set->capacity = 0;
+  for (int a=0; a<3; a++)
+  {
+    set->lo[a] = set->hi[a] = 0.0f;
+    set->scale[a] = 0.0f;
+  }
+  set->tick = 0;
+  set->x = NULL;
+  set->y = NULL;
+  set->z = NULL;
+  set->vx = NULL;
+  set->vy = NULL;
+  set->vz = NULL;
+  set->color = NULL;
+  set->fade = NULL;
+  set->dead = NULL;
+}
+
+bool particle_packed_resize (particle_packed* set, int size)
+{
+  particle_packed_free (set);
+  if (size < 0)
+    return false;
+  int capacity = padded (size);
+  if (capacity == 0)
+    return true;
+
+  set->x = aligned_shorts (capacity);
+  set->y = aligned_shorts (capacity);
+  set->z = aligned_shorts (capacity);
+  set->vx = aligned_shorts (capacity);
+  set->vy = aligned_shorts (capacity);
+  set->vz = aligned_shorts (capacity);
+  set->color = aligned_shorts (capacity);
+  set->fade = aligned_shorts (capacity);
+  set->dead = (int*) aligned_block (capacity, sizeof(int));
+  if (set->x == NULL || set->y == NULL || set->z == NULL || set->vx == NULL || set->vy == NULL ||
+      set->vz == NULL || set->color == NULL || set->fade == NULL || set->dead == NULL)
+  {
+    particle_packed_free (set);
+    return false;
+  }
+  set->size = size;
+  set->capacity = capacity;
+  return true;
+}
+
+void particle_packed_free (particle_packed* set)
+{
+  free (set->x);
+  free (set->y);
+  free (set->z);
+  free (set->vx);
+  free (set->vy);
+  free (set->vz);
+  free (set->color);
+  free (set->fade);
+  free (set->dead);
+  particle_packed_init (set);
+}
+
+bool particle_packed_encode (particle_packed* set, const particle_set* from, const float* lo, const float* hi)
+{
+  if (from->count > set->size)
+    return false;
+  for (int a=0; a<3; a++)
+    if (!(hi[a] > lo[a]))
+      return false;
+
+  float inv_scale[3];
+  for (int a=0; a<3; a++)
+  {
+    set->lo[a] = lo[a];
+    set->hi[a] = hi[a];
+    set->scale[a] = (hi[a] - lo[a]) / PACKED_TOP;
+    inv_scale[a] = PACKED_TOP / (hi[a] - lo[a]);
+  }
+  for (int i=0; i<from->count; i++)
+  {
+    set->x[i] = quantize (from->x[i], lo[0], inv_scale[0]);
+    set->y[i] = quantize (from->y[i], lo[1], inv_scale[1]);
+    set->z[i] = quantize (from->z[i], lo[2], inv_scale[2]);
+    set->vx[i] = float_to_half (velocity_quanta (from->vx[i], inv_scale[0]));
+    set->vy[i] = float_to_half (velocity_quanta (from->vy[i], inv_scale[1]));
+    set->vz[i] = float_to_half (velocity_quanta (from->vz[i], inv_scale[2]));
+    set->color[i] = life_units (from->color[i]);
+    set->fade[i] = life_units (from->fade[i]);
+    if (set->fade[i] == 0 && from->fade[i] > 0.0f)
+      set->fade[i] = 1;
+  }
+  set->count = from->count;
+  set->tick = 0;
+  clear_tail (set);
+  return true;
+}
+
+/**Step particles [first, last) in place and list the ones that died below count in dead,
+ * ascending; first and last are multiples of PARTICLE_LANES
+ * @return number that died
+*/
+static int step_range (particle_packed* set, int first, int last, int count, int* dead, unsigned int seed)
+{
+  int died = 0;
+  int i = first;
+
+#if defined(__AVX2__) && defined(__F16C__)
+  const __m256i step = _mm256_set1_epi32 ((int)(8 * 0x9e3779b1u));
+  const __m256i mix = _mm256_set1_epi32 ((int)0x2c1b3c6du);
+  const __m256i seeds = _mm256_set1_epi32 ((int)seed);
+  const __m256i bits = _mm256_set1_epi32 (1023);
+  const __m256 unit = _mm256_set1_ps (1.0f / 1024.0f);
+  unsigned short* q[3] = {set->x, set->y, set->z};
+  const unsigned short* v[3] = {set->vx, set->vy, set->vz};
+  //i * 0x9e3779b1 of the 8 slots, one add a vector
+  __m256i key = _mm256_mullo_epi32 (_mm256_add_epi32 (_mm256_set1_epi32 (i), _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7)),
+                                    _mm256_set1_epi32 ((int)0x9e3779b1u));
+  for (; i<last; i+=8, key=_mm256_add_epi32 (key, step))
+  {
+    __m256i h = _mm256_xor_si256 (key, seeds);
+    h = _mm256_xor_si256 (h, _mm256_srli_epi32 (h, 15));
+    h = _mm256_mullo_epi32 (h, mix);
+    h = _mm256_xor_si256 (h, _mm256_srli_epi32 (h, 13));
+    for (int a=0; a<3; a++)
+    {
+      __m256 offset = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (h, a * 10), bits)), unit);
+      __m256 p = _mm256_cvtepi32_ps (_mm256_cvtepu16_epi32 (_mm_load_si128 ((const __m128i*)(q[a] + i))));
+      __m256 vel = _mm256_cvtph_ps (_mm_load_si128 ((const __m128i*)(v[a] + i)));
+      //truncated, and clamped to 0 to 65535 by the unsigned saturation of the pack
+      __m256i n = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_add_ps (p, vel), offset));
+      _mm_store_si128 ((__m128i*)(q[a] + i),
+                       _mm_packus_epi32 (_mm256_castsi256_si128 (n), _mm256_extracti128_si256 (n, 1)));
+    }
+    __m128i c = _mm_subs_epu16 (_mm_load_si128 ((const __m128i*)(set->color + i)),
+                                _mm_load_si128 ((const __m128i*)(set->fade + i)));
+    _mm_store_si128 ((__m128i*)(set->color + i), c);
+    __m128i gone = _mm_cmpeq_epi16 (c, _mm_setzero_si128());
+    for (int m = _mm_movemask_epi8 (_mm_packs_epi16 (gone, _mm_setzero_si128())); m != 0; m &= m - 1)
+      if (i + __builtin_ctz (m) < count)
+        dead[died++] = i + __builtin_ctz (m);
+  }
+#endif
+  for (; i<last; i++)
+  {
+    unsigned int h = slot_bits ((unsigned int)i, seed);
+    set->x[i] = move_quanta (set->x[i], set->vx[i], offset_of (h, 0));
+    set->y[i] = move_quanta (set->y[i], set->vy[i], offset_of (h, 1));
+    set->z[i] = move_quanta (set->z[i], set->vz[i], offset_of (h, 2));
+    set->color[i] = set->color[i] > set->fade[i] ? set->color[i] - set->fade[i] : 0;
+    if (set->color[i] == 0 && i < count)
+      dead[died++] = i;
+  }
+  return died;
+}
+
+/**Fill the slots listed in set->dead with the last live particles, as particle_set does
+*/
+static void remove_dead (particle_packed* set, int died)
+{
+  const int* dead = set->dead;
+  int live = set->count - died;
+  int src = set->count - 1;
+  int tail = died - 1;
+
+  for (int k=0; k<died && dead[k]<live; k++)
+  {
+    //the last slots may be dead themselves
+    while (tail >= 0 && dead[tail] == src)
+    {
+      tail--;
+      src--;
+    }
+    int d = dead[k];
+    set->x[d] = set->x[src];
+    set->y[d] = set->y[src];
+    set->z[d] = set->z[src];
+    set->vx[d] = set->vx[src];
+    set->vy[d] = set->vy[src];
+    set->vz[d] = set->vz[src];
+    set->color[d] = set->color[src];
+    set->fade[d] = set->fade[src];
+    src--;
+  }
+  set->count = live;
+  clear_tail (set);
+}
+
+int particle_packed_step (particle_packed* set, int threads)
+{
+  int count = set->count;
+  int last = padded (count);
+  int chunk = chunk_size();
+  int died = 0;
+  unsigned int seed = set->tick * 0x85ebca77u;
+  set->tick++;
+  if (count == 0)
+    return 0;
+
+  if (last <= chunk || threads == 1)
+  {
+    died = step_range (set, 0, last, count, set->dead, seed);
+  }
+  else
+  {
+    //every chunk lists its dead in its own part of set->dead, then the lists are joined
+    int chunks = (last + chunk - 1) / chunk;
+    std::vector<int> chunk_died (chunks, 0);
+    aclib::parallel_for (chunks, threads, [&](int c)
+    {
+      int first = c * chunk;
+      int end = first + chunk < last ? first + chunk : last;
+      chunk_died[c] = step_range (set, first, end, count, set->dead + first, seed);
+    });
+    for (int c=0; c<chunks; c++)
+    {
+      if (chunk_died[c] > 0 && died != c * chunk)
+        memmove (set->dead + died, set->dead + c * chunk, chunk_died[c] * sizeof(int));
+      died += chunk_died[c];
+    }
+  }
+  remove_dead (set, died);
+  return set->count;
+}
+
+/**Vertices of the particles [first, last), from out on, as particle_set_pack
+*/
+static void pack_range (const particle_packed* set, int first, int last, bool triangles, float size, particle_vertex* out)
+{
+  for (int i=first; i<last; i++)
+  {
+    particle_vertex v;
+    v.r = v.g = (unsigned char)(set->color[i] * (255.0f / PACKED_TOP) + 0.5f);
+    v.b = 0;
+    v.a = 0xff;
+    v.x = set->lo[0] + set->x[i] * set->scale[0];
+    v.y = set->lo[1] + set->y[i] * set->scale[1];
+    v.z = set->lo[2] + set->z[i] * set->scale[2];
+    if (!triangles)
+    {
+      *out++ = v;
+      continue;
+    }
+    out[0] = out[1] = out[2] = v;
+    out[0].x += size;
+    out[1].x += size;
+    out[1].y += size;
+    out[2].y += size;
+    out += 3;
+  }
+}
+
+int particle_packed_pack (const particle_packed* set, bool triangles, float size, particle_vertex* out, int threads)
+{
+  int per = triangles ? 3 : 1;
+  int chunk = chunk_size();
+  int chunks = (set->count + chunk - 1) / chunk;
+
+  aclib::parallel_for (chunks, threads, [&](int c)
+  {
+    int last = (c + 1) * chunk < set->count ? (c + 1) * chunk : set->count;
+    pack_range (set, c * chunk, last, triangles, size, out + (size_t)c * chunk * per);
+  });
+  return set->count * per;
+}
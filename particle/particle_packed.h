@@ -0,0 +1,84 @@
+/**Author: Un Hou (Albert) Chan
+ * Packed particle storage for very large explosions: 16 bytes a particle instead of 32.
+ * Dependancy: "particle.h", "../aclib/parallel.h"
+ *
+ * A step of particle_set is memory bound, so storing each attribute in 16 bits halves
+ * its cost:
+ * - positions are 16 bit fixed point within a bounding box fixed at encode time (the space
+ *   the explosion can reach), one quantum being (hi - lo) / 65535 per axis. Particles stay
+ *   clamped inside the box
+ * - velocities are IEEE half floats in quanta per step, only read by a step
+ * - color (remaining life) is 16 bit unsigned normalized, and fade is in the same units, so
+ *   a step is an exact saturating integer subtraction
+ *
+ * The step works on the packed arrays directly: with AVX2 and F16C (-mavx2 -mf16c) 8
+ * particles are widened to floats in registers, moved, and narrowed back; otherwise a
+ * scalar loop does the same with software half floats. A move smaller than a quantum
+ * would round to nothing every step, so positions are rounded stochastically with a hash
+ * of the slot and the step, which keeps slow particles moving at the right average speed.
+ * Dead particles are removed as in particle_set (swap-remove), so live ones fill [0, count).
+ *
+ * Particles only come in through particle_packed_encode, from a float set; emitters, forces
+ * and collisions stay with particle_set.
+*/
+#pragma once
+#include "particle.h"
+
+/**int count; live particles, [0, count)
+ * int size; most particles
+ * int capacity; padded length of every array
+ * float lo[3], hi[3]; box of the positions
+ * float scale[3]; world unit per quantum, (hi - lo) / 65535
+ * unsigned int tick; steps taken, seeds the rounding
+ * unsigned short* x, *y, *z; positions, quanta from lo
+ * unsigned short* vx, *vy, *vz; velocities, half floats, quanta per step
+ * unsigned short* color; remaining life, 65535 full
+ * unsigned short* fade; life lost per step, same units
+ * int* dead; scratch of the step, slots that died
+*/
+typedef struct particle_packed
+{
+  int count;
+  int size;
+  int capacity;
+  float lo[3];
+  float hi[3];
+  float scale[3];
+  unsigned int tick;
+  unsigned short* x;
+  unsigned short* y;
+  unsigned short* z;
+  unsigned short* vx;
+  unsigned short* vy;
+  unsigned short* vz;
+  unsigned short* color;
+  unsigned short* fade;
+  int* dead;
+} particle_packed;
+
+/**Initialize an empty set. Must be called before particle_packed_resize
+*/
+void particle_packed_init (particle_packed* set);
+/**Make room for size particles, none alive
+ * @return false if out of memory, the set is then empty
+*/
+bool particle_packed_resize (particle_packed* set, int size);
+void particle_packed_free (particle_packed* set);
+/**Replace the particles of set by the live particles of from, positions quantized within
+ * the box [lo, hi] (clamped to it). Fade 0 (immortal) stays 0; any other fade is at least
+ * one unit, so every mortal particle dies
+ * @return false if from has more particles than set has room for, or the box is empty along
+ *   an axis
+*/
+bool particle_packed_encode (particle_packed* set, const particle_set* from, const float* lo, const float* hi);
+/**One step in place: every live particle moved by its velocity and its color lowered by its
+ * fade, then the ones down to 0 removed
+ * @param threads <= 0 means one per hardware thread
+ * @return live particles after the step
+*/
+int particle_packed_step (particle_packed* set, int threads);
+/**Write the vertices of every live particle to out, as particle_set_pack
+ * @param out room for count vertices, times 3 for triangles. May be a mapped buffer
+ * @return number of vertices written
+*/
+int particle_packed_pack (const particle_packed* set, bool triangles, float size, particle_vertex* out, int threads);
@@ -0,0 +1,147 @@
+/**Author: Un Hou (Albert) Chan
+ * Dependancy: "particle_sim.h", "particle.h", "collide.h"
+*/
+
+#include "particle_sim.h"
+
+/**Worker thread: run the queued steps into the back buffer, outside the lock. The emitter
+ * is copied in under the lock and its random state and carry copied back, so bursts and
+ * rates set meanwhile are kept for the next job
+*/
+static void sim_worker (particle_sim* sim)
+{
+  std::unique_lock<std::mutex> guard (sim->lock);
+  for (;;)
+  {
+    while (sim->pending == 0 && !sim->stop)
+      sim->wake_worker.wait (guard);
+    if (sim->stop)
+      break;
+    int steps = sim->pending;
+    particle_emitter em = sim->emitter;
+    particle_forces forces = sim->forces;
+    float radius = sim->radius;
+    float restitution = sim->restitution;
+    sim->emitter.burst = 0;
+    guard.unlock();
+
+    const particle_set* from = &sim->buf[sim->front];
+    particle_set* back = &sim->buf[1 - sim->front];
+    for (int s=0; s<steps; s++)
+    {
+      particle_set_step (s == 0 ? from : back, back, &forces, sim->threads);
+      if (radius > 0.0f)
+        particle_collide (back, &sim->grid, radius, restitution, sim->threads);
+      particle_emit (back, &em);
+    }
+    int visible = back->count;
+
+    guard.lock();
+    sim->emitter.rng = em.rng;
+    sim->emitter.carry = em.carry;
+    sim->back_visible = visible;
+    sim->ready = true;
+    sim->pending = 0;
+    sim->wake_caller.notify_one();
+  }
+}
+
+/**Wait until the worker is idle. Caller holds the lock
+*/
+static void sim_wait (particle_sim* sim, std::unique_lock<std::mutex>& guard)
+{
+  while (sim->pending > 0)
+    sim->wake_caller.wait (guard);
+}
+
+bool particle_sim_open (particle_sim* sim, int size, const particle_emitter* emitter, int threads)
+{
+  particle_set_init (&sim->buf[0]);
+  particle_set_init (&sim->buf[1]);
+  if (!particle_set_resize (&sim->buf[0], size) || !particle_set_resize (&sim->buf[1], size))
+  {
+    particle_set_free (&sim->buf[0]);
+    particle_set_free (&sim->buf[1]);
+    return false;
+  }
+  sim->front = 0;
+  sim->emitter = *emitter;
+  particle_forces_init (&sim->forces);
+  sim->radius = 0.0f;
+  sim->restitution = 1.0f;
+  particle_grid_init (&sim->grid);
+  sim->threads = threads;
+  sim->pending = 0;
+  sim->ready = false;
+  sim->stop = false;
+  sim->visible = 0;
+  sim->back_visible = 0;
+  sim->generation = 0;
+  sim->worker = std::thread (sim_worker, sim);
+  return true;
+}
+
+void particle_sim_burst (particle_sim* sim, int count)
+{
+  std::lock_guard<std::mutex> guard (sim->lock);
+  sim->emitter.burst += count;
+}
+
+void particle_sim_rate (particle_sim* sim, float rate)
+{
+  std::lock_guard<std::mutex> guard (sim->lock);
+  sim->emitter.rate = rate;
+  if (rate <= 0.0f)
+    sim->emitter.carry = 0.0f;
+}
+
+void particle_sim_forces (particle_sim* sim, const particle_forces* forces)
+{
+  std::lock_guard<std::mutex> guard (sim->lock);
+  sim->forces = *forces;
+}
+
+void particle_sim_collisions (particle_sim* sim, float radius, float restitution)
+{
+  std::lock_guard<std::mutex> guard (sim->lock);
+  sim->radius = radius;
+  sim->restitution = restitution;
+}
+
+int particle_sim_advance (particle_sim* sim, int steps)
+{
+  std::unique_lock<std::mutex> guard (sim->lock);
+  sim_wait (sim, guard);
+  if (sim->ready)
+  {
+    sim->front = 1 - sim->front;
+    sim->visible = sim->back_visible;
+    sim->ready = false;
+    sim->generation++;
+  }
+  if (steps > 0)
+  {
+    sim->pending = steps;
+    sim->wake_worker.notify_one();
+  }
+  return sim->visible;
+}
+
+void particle_sim_close (particle_sim* sim)
+{
+  {
+    std::lock_guard<std::mutex> guard (sim->lock);
+    sim->stop = true;
+    sim->wake_worker.notify_one();
+  }
+  if (sim->worker.joinable())
+    sim->worker.join();
+  particle_set_free (&sim->buf[0]);
+  particle_set_free (&sim->buf[1]);
+  particle_grid_free (&sim->grid);
+}
+
+particle_sim::~particle_sim ()
+{
+  particle_sim_close (this);
+}
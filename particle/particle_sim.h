@@ -0,0 +1,91 @@
+/**Author: Un Hou (Albert) Chan
+ * Particle simulation running beside the renderer, double buffered.
+ * Dependancy: "particle.h", "collide.h"
+ *
+ * Two particle_sets: the front one holds the last finished step and is only read (drawn),
+ * the back one is written by a worker thread. particle_sim_advance waits for the running
+ * job, makes its result the front buffer, and hands the worker the next steps, which run
+ * while the caller draws the new front. The first queued step reads the front and writes
+ * the back, the others step the back in place, so the front is never written while the
+ * worker runs. After every step the worker runs the emitter on the back buffer, so
+ * particles are born and die only there. Deciding how many steps are due (fixed timestep)
+ * is left to the caller.
+*/
+#pragma once
+#include "particle.h"
+#include "collide.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**particle_set buf[2]; front and back buffer
+ * int front; index of the front buffer
+ * particle_emitter emitter; source of the particles, run after every step
+ * particle_forces forces; forces of every step
+ * float radius, restitution; collisions after every step, radius 0 for none, see particle_collide
+ * particle_grid grid; collision grid, the worker's only
+ * int threads; threads of every step, see particle_set_step
+ * int pending; steps handed to the worker and not finished
+ * bool ready; the back buffer holds a finished job not swapped in yet
+ * int visible; live particles of the front buffer
+ * int back_visible; live particles of the back buffer once the job is done
+ * int generation; bumped whenever the front buffer changes, so drawing can skip re-uploads
+ * The destructor runs particle_sim_close, so a sim left open at exit() stops its worker
+ * instead of destroying a joinable thread
+*/
+typedef struct particle_sim
+{
+  particle_set buf[2];
+  int front;
+  particle_emitter emitter;
+  particle_forces forces;
+  float radius;
+  float restitution;
+  particle_grid grid;
+  int threads;
+  int pending;
+  bool ready;
+  bool stop;
+  int visible;
+  int back_visible;
+  int generation;
+  std::mutex lock;
+  std::condition_variable wake_worker;
+  std::condition_variable wake_caller;
+  std::thread worker;
+
+  ~particle_sim ();
+} particle_sim;
+
+/**Allocate both buffers for size particles, none alive, no forces and no collisions, and start the worker
+ * @param emitter copied, see particle_emitter
+ * @return false if out of memory
+*/
+bool particle_sim_open (particle_sim* sim, int size, const particle_emitter* emitter, int threads);
+/**Emit count particles at once on the next step
+*/
+void particle_sim_burst (particle_sim* sim, int count);
+/**Emit rate particles per step from the next step on, 0 to stop
+*/
+void particle_sim_rate (particle_sim* sim, float rate);
+/**Forces of the steps from the next job on, copied; see particle_forces
+*/
+void particle_sim_forces (particle_sim* sim, const particle_forces* forces);
+/**Collisions of the steps from the next job on: particles of radius bounce off each other.
+ * 0 turns them off
+*/
+void particle_sim_collisions (particle_sim* sim, float radius, float restitution);
+/**Finish the running job and swap it to the front, then queue steps more (0 for none)
+ * @return live particles of the new front buffer
+*/
+int particle_sim_advance (particle_sim* sim, int steps);
+/**Buffer to draw until the next particle_sim_advance. Only read it
+*/
+inline const particle_set* particle_sim_front (const particle_sim* sim)
+{
+  return &sim->buf[sim->front];
+}
+/**Stop the worker and release both buffers. Closing again does nothing
+*/
+void particle_sim_close (particle_sim* sim);